@@ -0,0 +1,411 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * Mixer controls and sysfs attributes of the card
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#include <linux/device.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+#include <sound/control.h>
+#include <sound/core.h>
+#include <sound/tlv.h>
+
+#include "driver.h"
+#include "control.h"
+#include "pcm.h"
+#include "pack.h"
+#include "timer.h"
+
+static const char *const zoom_profile_names[ZOOM_PROFILE_COUNT] = {
+	[ZOOM_PROFILE_ULTRA_LOW] = "ultra-low",
+	[ZOOM_PROFILE_BALANCED] = "balanced",
+	[ZOOM_PROFILE_ROBUST] = "robust",
+};
+
+static int zoom_profile_info(struct snd_kcontrol *kctl,
+			     struct snd_ctl_elem_info *info)
+{
+	return snd_ctl_enum_info(info, 1, ZOOM_PROFILE_COUNT,
+				 zoom_profile_names);
+}
+
+static int zoom_profile_get(struct snd_kcontrol *kctl,
+			    struct snd_ctl_elem_value *value)
+{
+	struct zoom_chip *chip = snd_kcontrol_chip(kctl);
+
+	value->value.enumerated.item[0] = zoom_pcm_get_profile(chip);
+	return 0;
+}
+
+static int zoom_profile_put(struct snd_kcontrol *kctl,
+			    struct snd_ctl_elem_value *value)
+{
+	struct zoom_chip *chip = snd_kcontrol_chip(kctl);
+	unsigned int profile = value->value.enumerated.item[0];
+	int ret;
+
+	if (profile == zoom_pcm_get_profile(chip))
+		return 0;
+
+	ret = zoom_pcm_set_profile(chip, profile);
+	return ret < 0 ? ret : 1;
+}
+
+static const struct snd_kcontrol_new zoom_profile_ctl = {
+	.iface = SNDRV_CTL_ELEM_IFACE_CARD,
+	.name = "Latency Profile",
+	.access = SNDRV_CTL_ELEM_ACCESS_READWRITE,
+	.info = zoom_profile_info,
+	.get = zoom_profile_get,
+	.put = zoom_profile_put,
+};
+
+/* channels that reached the threshold in the last capture period */
+static int zoom_activity_info(struct snd_kcontrol *kctl,
+			      struct snd_ctl_elem_info *info)
+{
+	struct zoom_chip *chip = snd_kcontrol_chip(kctl);
+
+	info->type = SNDRV_CTL_ELEM_TYPE_BOOLEAN;
+	info->count = chip->model->in_channels;
+	info->value.integer.min = 0;
+	info->value.integer.max = 1;
+	return 0;
+}
+
+static int zoom_activity_get(struct snd_kcontrol *kctl,
+			     struct snd_ctl_elem_value *value)
+{
+	struct zoom_chip *chip = snd_kcontrol_chip(kctl);
+	u32 active = zoom_pcm_get_activity(chip);
+	unsigned int i;
+
+	for (i = 0; i < chip->model->in_channels; i++)
+		value->value.integer.value[i] = !!(active & BIT(i));
+	return 0;
+}
+
+static const struct snd_kcontrol_new zoom_activity_ctl = {
+	.iface = SNDRV_CTL_ELEM_IFACE_PCM,
+	.name = "Capture Activity",
+	.access = SNDRV_CTL_ELEM_ACCESS_READ |
+		  SNDRV_CTL_ELEM_ACCESS_VOLATILE,
+	.info = zoom_activity_info,
+	.get = zoom_activity_get,
+};
+
+/* 16 bit sample scale */
+static int zoom_threshold_info(struct snd_kcontrol *kctl,
+			       struct snd_ctl_elem_info *info)
+{
+	info->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	info->count = 1;
+	info->value.integer.min = 0;
+	info->value.integer.max = 32767;
+	return 0;
+}
+
+static int zoom_threshold_get(struct snd_kcontrol *kctl,
+			      struct snd_ctl_elem_value *value)
+{
+	struct zoom_chip *chip = snd_kcontrol_chip(kctl);
+
+	value->value.integer.value[0] = zoom_pcm_get_activity_threshold(chip);
+	return 0;
+}
+
+static int zoom_threshold_put(struct snd_kcontrol *kctl,
+			      struct snd_ctl_elem_value *value)
+{
+	struct zoom_chip *chip = snd_kcontrol_chip(kctl);
+	long threshold = value->value.integer.value[0];
+
+	if (threshold < 0 || threshold > 32767)
+		return -EINVAL;
+	if (threshold == zoom_pcm_get_activity_threshold(chip))
+		return 0;
+
+	zoom_pcm_set_activity_threshold(chip, threshold);
+	return 1;
+}
+
+static const struct snd_kcontrol_new zoom_threshold_ctl = {
+	.iface = SNDRV_CTL_ELEM_IFACE_PCM,
+	.name = "Capture Activity Threshold",
+	.access = SNDRV_CTL_ELEM_ACCESS_READWRITE,
+	.info = zoom_threshold_info,
+	.get = zoom_threshold_get,
+	.put = zoom_threshold_put,
+};
+
+/* private_value: 1 playback, 0 capture */
+static unsigned int zoom_gain_channels(struct snd_kcontrol *kctl)
+{
+	struct zoom_chip *chip = snd_kcontrol_chip(kctl);
+
+	return kctl->private_value ? chip->model->out_channels :
+				     chip->model->in_channels;
+}
+
+/* Q16 gain per channel, 0 (mute) .. ZOOM_GAIN_MAX (+12 dB) */
+static int zoom_volume_info(struct snd_kcontrol *kctl,
+			    struct snd_ctl_elem_info *info)
+{
+	info->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	info->count = zoom_gain_channels(kctl);
+	info->value.integer.min = 0;
+	info->value.integer.max = ZOOM_GAIN_MAX;
+	return 0;
+}
+
+static int zoom_volume_get(struct snd_kcontrol *kctl,
+			   struct snd_ctl_elem_value *value)
+{
+	struct zoom_chip *chip = snd_kcontrol_chip(kctl);
+	u32 gain[ZOOM_MAX_SLOTS], mute;
+	unsigned int i;
+
+	zoom_pcm_get_gain(chip, kctl->private_value, gain, &mute);
+	for (i = 0; i < zoom_gain_channels(kctl); i++)
+		value->value.integer.value[i] = gain[i];
+	return 0;
+}
+
+static int zoom_volume_put(struct snd_kcontrol *kctl,
+			   struct snd_ctl_elem_value *value)
+{
+	struct zoom_chip *chip = snd_kcontrol_chip(kctl);
+	u32 gain[ZOOM_MAX_SLOTS], mute;
+	unsigned int i;
+	long v;
+
+	zoom_pcm_get_gain(chip, kctl->private_value, gain, &mute);
+	for (i = 0; i < zoom_gain_channels(kctl); i++) {
+		v = value->value.integer.value[i];
+		if (v < 0 || v > ZOOM_GAIN_MAX)
+			return -EINVAL;
+		gain[i] = v;
+	}
+
+	return zoom_pcm_set_gain(chip, kctl->private_value, gain, mute);
+}
+
+static int zoom_switch_info(struct snd_kcontrol *kctl,
+			    struct snd_ctl_elem_info *info)
+{
+	info->type = SNDRV_CTL_ELEM_TYPE_BOOLEAN;
+	info->count = zoom_gain_channels(kctl);
+	info->value.integer.min = 0;
+	info->value.integer.max = 1;
+	return 0;
+}
+
+/* 1 = on, as every alsa switch */
+static int zoom_switch_get(struct snd_kcontrol *kctl,
+			   struct snd_ctl_elem_value *value)
+{
+	struct zoom_chip *chip = snd_kcontrol_chip(kctl);
+	u32 gain[ZOOM_MAX_SLOTS], mute;
+	unsigned int i;
+
+	zoom_pcm_get_gain(chip, kctl->private_value, gain, &mute);
+	for (i = 0; i < zoom_gain_channels(kctl); i++)
+		value->value.integer.value[i] = !(mute & BIT(i));
+	return 0;
+}
+
+static int zoom_switch_put(struct snd_kcontrol *kctl,
+			   struct snd_ctl_elem_value *value)
+{
+	struct zoom_chip *chip = snd_kcontrol_chip(kctl);
+	u32 gain[ZOOM_MAX_SLOTS], mute;
+	unsigned int i;
+
+	zoom_pcm_get_gain(chip, kctl->private_value, gain, &mute);
+	for (i = 0; i < zoom_gain_channels(kctl); i++) {
+		if (value->value.integer.value[i])
+			mute &= ~BIT(i);
+		else
+			mute |= BIT(i);
+	}
+
+	return zoom_pcm_set_gain(chip, kctl->private_value, gain, mute);
+}
+
+static const DECLARE_TLV_DB_LINEAR(zoom_gain_tlv, TLV_DB_GAIN_MUTE, 1204);
+
+#define ZOOM_VOLUME_CTL(_name, _playback)				\
+	{								\
+		.iface = SNDRV_CTL_ELEM_IFACE_MIXER,			\
+		.name = _name,						\
+		.access = SNDRV_CTL_ELEM_ACCESS_READWRITE |		\
+			  SNDRV_CTL_ELEM_ACCESS_TLV_READ,		\
+		.info = zoom_volume_info,				\
+		.get = zoom_volume_get,					\
+		.put = zoom_volume_put,					\
+		.tlv.p = zoom_gain_tlv,					\
+		.private_value = _playback,				\
+	}
+
+#define ZOOM_SWITCH_CTL(_name, _playback)				\
+	{								\
+		.iface = SNDRV_CTL_ELEM_IFACE_MIXER,			\
+		.name = _name,						\
+		.access = SNDRV_CTL_ELEM_ACCESS_READWRITE,		\
+		.info = zoom_switch_info,				\
+		.get = zoom_switch_get,					\
+		.put = zoom_switch_put,					\
+		.private_value = _playback,				\
+	}
+
+static const struct snd_kcontrol_new zoom_gain_ctls[] = {
+	ZOOM_VOLUME_CTL("Playback Volume", 1),
+	ZOOM_SWITCH_CTL("Playback Switch", 1),
+	ZOOM_VOLUME_CTL("Capture Volume", 0),
+	ZOOM_SWITCH_CTL("Capture Switch", 0),
+};
+
+/* frames per tick of the sample clock timer */
+static int zoom_timer_frames_info(struct snd_kcontrol *kctl,
+				  struct snd_ctl_elem_info *info)
+{
+	info->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	info->count = 1;
+	info->value.integer.min = 1;
+	info->value.integer.max = ZOOM_TIMER_FRAMES_MAX;
+	return 0;
+}
+
+static int zoom_timer_frames_get(struct snd_kcontrol *kctl,
+				 struct snd_ctl_elem_value *value)
+{
+	struct zoom_chip *chip = snd_kcontrol_chip(kctl);
+
+	value->value.integer.value[0] = zoom_timer_get_frames(chip);
+	return 0;
+}
+
+static int zoom_timer_frames_put(struct snd_kcontrol *kctl,
+				 struct snd_ctl_elem_value *value)
+{
+	struct zoom_chip *chip = snd_kcontrol_chip(kctl);
+	long frames = value->value.integer.value[0];
+
+	if (frames < 1 || frames > ZOOM_TIMER_FRAMES_MAX)
+		return -EINVAL;
+	if (frames == zoom_timer_get_frames(chip))
+		return 0;
+
+	zoom_timer_set_frames(chip, frames);
+	return 1;
+}
+
+static const struct snd_kcontrol_new zoom_timer_frames_ctl = {
+	.iface = SNDRV_CTL_ELEM_IFACE_CARD,
+	.name = "Clock Timer Frames",
+	.access = SNDRV_CTL_ELEM_ACCESS_READWRITE,
+	.info = zoom_timer_frames_info,
+	.get = zoom_timer_frames_get,
+	.put = zoom_timer_frames_put,
+};
+
+static struct zoom_chip *zoom_dev_chip(struct device *dev)
+{
+	return container_of(dev, struct snd_card, card_dev)->private_data;
+}
+
+/* "ultra-low [balanced] robust" */
+static ssize_t latency_profile_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	unsigned int profile = zoom_pcm_get_profile(zoom_dev_chip(dev));
+	int len = 0;
+	int i;
+
+	for (i = 0; i < ZOOM_PROFILE_COUNT; i++)
+		len += sysfs_emit_at(buf, len, i == profile ? "[%s]%c" : "%s%c",
+				     zoom_profile_names[i],
+				     i == ZOOM_PROFILE_COUNT - 1 ? '\n' : ' ');
+	return len;
+}
+
+static ssize_t latency_profile_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	struct zoom_chip *chip = zoom_dev_chip(dev);
+	unsigned int old = zoom_pcm_get_profile(chip);
+	int ret;
+
+	ret = sysfs_match_string(zoom_profile_names, buf);
+	if (ret < 0)
+		return ret;
+
+	ret = zoom_pcm_set_profile(chip, ret);
+	if (ret < 0)
+		return ret;
+
+	if (zoom_pcm_get_profile(chip) != old)
+		snd_ctl_notify(chip->card, SNDRV_CTL_EVENT_MASK_VALUE,
+			       &chip->profile_ctl->id);
+	return count;
+}
+
+static DEVICE_ATTR_RW(latency_profile);
+
+static struct attribute *zoom_card_attrs[] = {
+	&dev_attr_latency_profile.attr,
+	NULL
+};
+
+static const struct attribute_group zoom_card_attr_group = {
+	.attrs = zoom_card_attrs,
+};
+
+/* call before snd_card_register() */
+int zoom_control_init(struct zoom_chip *chip)
+{
+	struct snd_kcontrol *kctl;
+	unsigned int i;
+	int ret;
+
+	kctl = snd_ctl_new1(&zoom_profile_ctl, chip);
+	ret = snd_ctl_add(chip->card, kctl); /* frees kctl on error */
+	if (ret < 0)
+		return ret;
+	chip->profile_ctl = kctl;
+
+	ret = snd_ctl_add(chip->card, snd_ctl_new1(&zoom_threshold_ctl, chip));
+	if (ret < 0)
+		return ret;
+
+	kctl = snd_ctl_new1(&zoom_activity_ctl, chip);
+	ret = snd_ctl_add(chip->card, kctl);
+	if (ret < 0)
+		return ret;
+	chip->activity_ctl = kctl;
+
+	ret = snd_ctl_add(chip->card,
+			  snd_ctl_new1(&zoom_timer_frames_ctl, chip));
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < ARRAY_SIZE(zoom_gain_ctls); i++) {
+		if (zoom_gain_ctls[i].private_value && zoom_pcm_zero_copy(chip))
+			continue; /* playback gain doesn't apply */
+		ret = snd_ctl_add(chip->card,
+				  snd_ctl_new1(&zoom_gain_ctls[i], chip));
+		if (ret < 0)
+			return ret;
+	}
+
+	return snd_card_add_dev_attr(chip->card, &zoom_card_attr_group);
+}
@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#ifndef ZOOM_CONTROL_H
+#define ZOOM_CONTROL_H
+
+struct zoom_chip;
+
+int zoom_control_init(struct zoom_chip *chip);
+#endif /* ZOOM_CONTROL_H */
@@ -0,0 +1,489 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * debugfs: raw URB recording (urb_log), capture replay (urb_replay) and
+ * URB fault injection (fault_*)
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/fs.h>
+#include <linux/kref.h>
+#include <linux/module.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/usb.h>
+#include <linux/vmalloc.h>
+#include <sound/core.h>
+
+#include "driver.h"
+#include "debug.h"
+#include "uapi.h"
+
+static unsigned int urb_log_kb = 4096;
+module_param(urb_log_kb, uint, 0444);
+MODULE_PARM_DESC(urb_log_kb, "debugfs URB log buffer size in KiB.");
+
+static unsigned int urb_replay_kb = 65536;
+module_param(urb_replay_kb, uint, 0444);
+MODULE_PARM_DESC(urb_replay_kb, "Max debugfs URB replay file size in KiB.");
+
+/* longest injected completion delay, busy waited in the urb handler with
+ * the hcd giveback blocked, so only a few packets long */
+#define ZOOM_FAULT_DELAY_MAX_US 50
+
+static struct dentry *zoom_debugfs_root;
+
+struct zoom_debug {
+	struct kref kref; /* chip and open files */
+	struct zoom_chip *chip; /* only while !dead, open files outlive it */
+	const struct zoom_model *model; /* static, safe without the chip */
+	struct dentry *dir;
+	spinlock_t lock;
+	bool dead;
+
+	/* urb_log: byte ring, the reader owns [log_tail, log_head) */
+	bool log_enabled;
+	u8 *log_buf;
+	size_t log_size;
+	size_t log_head;
+	size_t log_tail;
+	u64 log_dropped;
+	wait_queue_head_t log_wait;
+
+	/* urb_replay */
+	bool replay_open;
+	bool replay_armed;
+	u8 *replay_buf;
+	size_t replay_len;
+	size_t replay_alloc;
+	size_t replay_pos;
+	u64 replayed;
+	u64 replay_errors;  /* recorded failed urbs, skipped */
+
+	/* fault injection on every fault_every-th urb of the fault_dir
+	 * directions (bit n: ZOOM_URB_LOG_XXX n), 0 disables it */
+	u32 fault_every;
+	u32 fault_dir;
+	u32 fault_errno;    /* complete with status -errno */
+	bool fault_drop;    /* lose the completion, no resubmit */
+	bool fault_short;   /* halve actual_length of IN urbs */
+	u32 fault_delay_us; /* busy wait before processing and resubmit */
+	u32 fault_seen[2];  /* urbs per direction since the last fault */
+	u64 fault_injected;
+};
+
+static void zoom_debug_release_kref(struct kref *kref)
+{
+	struct zoom_debug *dbg = container_of(kref, struct zoom_debug, kref);
+
+	vfree(dbg->log_buf);
+	vfree(dbg->replay_buf);
+	kfree(dbg);
+}
+
+/* call with dbg->lock held and enough room */
+static void zoom_debug_log_put(struct zoom_debug *dbg, const void *data,
+			       size_t len)
+{
+	size_t off = dbg->log_head % dbg->log_size;
+	size_t n = min(len, dbg->log_size - off);
+
+	memcpy(dbg->log_buf + off, data, n);
+	memcpy(dbg->log_buf, data + n, len - n);
+	dbg->log_head += len;
+}
+
+/* called from the urb handlers before the buffer is processed */
+void zoom_debug_log_urb(struct zoom_chip *chip, struct urb *urb, u8 dir,
+			u64 tstamp_ns)
+{
+	struct zoom_debug *dbg = chip->debug;
+	struct zoom_urb_log_record rec;
+	unsigned long flags;
+	u32 len;
+
+	if (!dbg || !READ_ONCE(dbg->log_enabled))
+		return;
+
+	len = dir == ZOOM_URB_LOG_IN ? urb->actual_length :
+				       urb->transfer_buffer_length;
+
+	rec.tstamp_ns = tstamp_ns;
+	rec.status = urb->status;
+	rec.length = len;
+	rec.dir = dir;
+	rec.reserved = 0;
+
+	spin_lock_irqsave(&dbg->lock, flags);
+	if (dbg->log_enabled) {
+		if (dbg->log_size - (dbg->log_head - dbg->log_tail) <
+		    sizeof(rec) + len) {
+			dbg->log_dropped++;
+		} else {
+			zoom_debug_log_put(dbg, &rec, sizeof(rec));
+			zoom_debug_log_put(dbg, urb->transfer_buffer, len);
+		}
+	}
+	spin_unlock_irqrestore(&dbg->lock, flags);
+
+	if (wq_has_sleeper(&dbg->log_wait))
+		wake_up_interruptible(&dbg->log_wait);
+}
+
+/*
+ * Replace the payload of a completed IN urb with the next recorded one, so
+ * the capture path processes exactly the recorded frames. Recorded errors
+ * are skipped: the urb keeps its own status, a recorded failure must not
+ * stop the live stream (tools/zoom-replay shows them offline).
+ */
+bool zoom_debug_replay_in(struct zoom_chip *chip, struct urb *urb)
+{
+	struct zoom_debug *dbg = chip->debug;
+	struct zoom_urb_log_record rec;
+	unsigned long flags;
+	bool replayed = false;
+	u8 *payload;
+
+	if (!dbg || !READ_ONCE(dbg->replay_armed))
+		return false;
+
+	spin_lock_irqsave(&dbg->lock, flags);
+	while (dbg->replay_armed) {
+		if (dbg->replay_len - dbg->replay_pos < sizeof(rec)) {
+			dbg->replay_armed = false; /* end of recording */
+			break;
+		}
+
+		memcpy(&rec, dbg->replay_buf + dbg->replay_pos, sizeof(rec));
+		payload = dbg->replay_buf + dbg->replay_pos + sizeof(rec);
+		if (dbg->replay_len - dbg->replay_pos - sizeof(rec) <
+		    rec.length) {
+			dbg->replay_armed = false; /* truncated */
+			break;
+		}
+		dbg->replay_pos += sizeof(rec) + rec.length;
+
+		if (rec.dir != ZOOM_URB_LOG_IN)
+			continue;
+		if (rec.status) {
+			dbg->replay_errors++;
+			continue;
+		}
+
+		urb->actual_length = min_t(u32, rec.length,
+					   urb->transfer_buffer_length);
+		memcpy(urb->transfer_buffer, payload, urb->actual_length);
+		dbg->replayed++;
+		replayed = true;
+		break;
+	}
+	spin_unlock_irqrestore(&dbg->lock, flags);
+
+	return replayed;
+}
+
+/*
+ * Called from the urb handlers right after completion. Applies the
+ * configured faults to the urb, returns true if the completion is to be
+ * dropped.
+ */
+bool zoom_debug_fault(struct zoom_chip *chip, struct urb *urb, u8 dir)
+{
+	struct zoom_debug *dbg = chip->debug;
+	unsigned int frame_bytes = zoom_frame_bytes(chip->model);
+	unsigned long flags;
+	bool drop = false;
+	u32 delay_us = 0;
+
+	if (!dbg || !READ_ONCE(dbg->fault_every))
+		return false;
+
+	spin_lock_irqsave(&dbg->lock, flags);
+	if (dbg->fault_every && (dbg->fault_dir & BIT(dir)) &&
+	    ++dbg->fault_seen[dir] >= dbg->fault_every) {
+		dbg->fault_seen[dir] = 0;
+		dbg->fault_injected++;
+
+		if (dbg->fault_errno)
+			urb->status = -(int)dbg->fault_errno;
+		if (dbg->fault_short && dir == ZOOM_URB_LOG_IN)
+			urb->actual_length = rounddown(urb->actual_length / 2,
+						       frame_bytes);
+		drop = dbg->fault_drop;
+		delay_us = min_t(u32, dbg->fault_delay_us,
+				 ZOOM_FAULT_DELAY_MAX_US);
+	}
+	spin_unlock_irqrestore(&dbg->lock, flags);
+
+	if (delay_us)
+		udelay(delay_us);
+	return drop;
+}
+
+static int zoom_debug_log_open(struct inode *inode, struct file *file)
+{
+	struct zoom_debug *dbg = inode->i_private;
+	const struct zoom_model *model = dbg->model;
+	struct zoom_urb_log_header hdr = {
+		.magic = ZOOM_URB_LOG_MAGIC,
+		.version = ZOOM_URB_LOG_VERSION,
+		.slots = model->slots,
+		.rate = model->rates[0],
+	};
+	size_t size = (size_t)clamp(urb_log_kb, 64U, 1048576U) * 1024;
+	u8 *buf;
+
+	buf = vmalloc(size);
+	if (!buf)
+		return -ENOMEM;
+
+	spin_lock_irq(&dbg->lock);
+	if (dbg->log_buf || dbg->dead) {
+		spin_unlock_irq(&dbg->lock);
+		vfree(buf);
+		return -EBUSY;
+	}
+	dbg->log_buf = buf;
+	dbg->log_size = size;
+	dbg->log_head = 0;
+	dbg->log_tail = 0;
+	dbg->log_dropped = 0;
+	zoom_debug_log_put(dbg, &hdr, sizeof(hdr));
+	dbg->log_enabled = true;
+	kref_get(&dbg->kref);
+	spin_unlock_irq(&dbg->lock);
+
+	file->private_data = dbg;
+	return nonseekable_open(inode, file);
+}
+
+static int zoom_debug_log_release(struct inode *inode, struct file *file)
+{
+	struct zoom_debug *dbg = file->private_data;
+	u8 *buf;
+
+	spin_lock_irq(&dbg->lock);
+	dbg->log_enabled = false;
+	buf = dbg->log_buf;
+	dbg->log_buf = NULL;
+	spin_unlock_irq(&dbg->lock);
+
+	vfree(buf);
+	kref_put(&dbg->kref, zoom_debug_release_kref);
+	return 0;
+}
+
+static ssize_t zoom_debug_log_read(struct file *file, char __user *ubuf,
+				   size_t count, loff_t *ppos)
+{
+	struct zoom_debug *dbg = file->private_data;
+	size_t head, off, n;
+	int ret;
+
+	if (READ_ONCE(dbg->log_head) == dbg->log_tail) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(dbg->log_wait,
+			READ_ONCE(dbg->log_head) != dbg->log_tail ||
+			READ_ONCE(dbg->dead));
+		if (ret)
+			return ret;
+	}
+
+	spin_lock_irq(&dbg->lock);
+	head = dbg->log_head;
+	spin_unlock_irq(&dbg->lock);
+
+	if (head == dbg->log_tail)
+		return 0; /* device gone */
+
+	/* the producer doesn't touch [tail, head), copy without the lock */
+	count = min(count, head - dbg->log_tail);
+	off = dbg->log_tail % dbg->log_size;
+	n = min(count, dbg->log_size - off);
+	if (copy_to_user(ubuf, dbg->log_buf + off, n) ||
+	    copy_to_user(ubuf + n, dbg->log_buf, count - n))
+		return -EFAULT;
+
+	spin_lock_irq(&dbg->lock);
+	dbg->log_tail += count;
+	spin_unlock_irq(&dbg->lock);
+	return count;
+}
+
+static const struct file_operations zoom_debug_log_fops = {
+	.owner = THIS_MODULE,
+	.open = zoom_debug_log_open,
+	.release = zoom_debug_log_release,
+	.read = zoom_debug_log_read,
+};
+
+static int zoom_debug_replay_open(struct inode *inode, struct file *file)
+{
+	struct zoom_debug *dbg = inode->i_private;
+	u8 *old;
+
+	spin_lock_irq(&dbg->lock);
+	if (dbg->replay_open || dbg->dead) {
+		spin_unlock_irq(&dbg->lock);
+		return -EBUSY;
+	}
+	/* writing a new recording cancels the running replay */
+	dbg->replay_open = true;
+	dbg->replay_armed = false;
+	old = dbg->replay_buf;
+	dbg->replay_buf = NULL;
+	dbg->replay_len = 0;
+	dbg->replay_alloc = 0;
+	kref_get(&dbg->kref);
+	spin_unlock_irq(&dbg->lock);
+
+	vfree(old);
+	file->private_data = dbg;
+	return nonseekable_open(inode, file);
+}
+
+static ssize_t zoom_debug_replay_write(struct file *file,
+				       const char __user *ubuf,
+				       size_t count, loff_t *ppos)
+{
+	struct zoom_debug *dbg = file->private_data;
+	size_t max = (size_t)urb_replay_kb * 1024;
+	size_t alloc;
+	u8 *buf;
+
+	if (count > max - dbg->replay_len)
+		return -EFBIG;
+
+	/* not armed while open, the urb handlers don't look at it */
+	if (dbg->replay_len + count > dbg->replay_alloc) {
+		alloc = max_t(size_t, dbg->replay_alloc * 2, SZ_1M);
+		alloc = clamp(alloc, dbg->replay_len + count, max);
+		buf = vmalloc(alloc);
+		if (!buf)
+			return -ENOMEM;
+		if (dbg->replay_buf)
+			memcpy(buf, dbg->replay_buf, dbg->replay_len);
+		vfree(dbg->replay_buf);
+		dbg->replay_buf = buf;
+		dbg->replay_alloc = alloc;
+	}
+
+	if (copy_from_user(dbg->replay_buf + dbg->replay_len, ubuf, count))
+		return -EFAULT;
+	dbg->replay_len += count;
+	return count;
+}
+
+static int zoom_debug_replay_release(struct inode *inode, struct file *file)
+{
+	struct zoom_debug *dbg = file->private_data;
+	const struct zoom_urb_log_header *hdr = (void *)dbg->replay_buf;
+	bool valid;
+
+	valid = dbg->replay_len >= sizeof(*hdr) &&
+		hdr->magic == ZOOM_URB_LOG_MAGIC &&
+		hdr->version == ZOOM_URB_LOG_VERSION &&
+		hdr->slots == dbg->model->slots;
+
+	spin_lock_irq(&dbg->lock);
+	if (dbg->replay_len && !valid && !dbg->dead)
+		dev_warn(&dbg->chip->dev->dev, "invalid URB replay file\n");
+	dbg->replay_pos = sizeof(*hdr);
+	dbg->replayed = 0;
+	dbg->replay_errors = 0;
+	dbg->replay_armed = valid;
+	dbg->replay_open = false;
+	spin_unlock_irq(&dbg->lock);
+
+	kref_put(&dbg->kref, zoom_debug_release_kref);
+	return 0;
+}
+
+static const struct file_operations zoom_debug_replay_fops = {
+	.owner = THIS_MODULE,
+	.open = zoom_debug_replay_open,
+	.release = zoom_debug_replay_release,
+	.write = zoom_debug_replay_write,
+};
+
+int zoom_debug_init(struct zoom_chip *chip)
+{
+	struct zoom_debug *dbg;
+	char name[16];
+
+	dbg = kzalloc(sizeof(*dbg), GFP_KERNEL);
+	if (!dbg)
+		return -ENOMEM;
+
+	kref_init(&dbg->kref);
+	spin_lock_init(&dbg->lock);
+	init_waitqueue_head(&dbg->log_wait);
+	dbg->chip = chip;
+	dbg->model = chip->model;
+
+	snprintf(name, sizeof(name), "card%d", chip->card->number);
+	dbg->dir = debugfs_create_dir(name, zoom_debugfs_root);
+	debugfs_create_file("urb_log", 0400, dbg->dir, dbg,
+			    &zoom_debug_log_fops);
+	debugfs_create_u64("urb_log_dropped", 0444, dbg->dir,
+			   &dbg->log_dropped);
+	debugfs_create_file("urb_replay", 0200, dbg->dir, dbg,
+			    &zoom_debug_replay_fops);
+	debugfs_create_u64("urb_replayed", 0444, dbg->dir, &dbg->replayed);
+	debugfs_create_u64("urb_replay_errors", 0444, dbg->dir,
+			   &dbg->replay_errors);
+
+	dbg->fault_dir = BIT(ZOOM_URB_LOG_IN) | BIT(ZOOM_URB_LOG_OUT);
+	debugfs_create_u32("fault_every", 0600, dbg->dir, &dbg->fault_every);
+	debugfs_create_u32("fault_dir", 0600, dbg->dir, &dbg->fault_dir);
+	debugfs_create_u32("fault_errno", 0600, dbg->dir, &dbg->fault_errno);
+	debugfs_create_bool("fault_drop", 0600, dbg->dir, &dbg->fault_drop);
+	debugfs_create_bool("fault_short", 0600, dbg->dir, &dbg->fault_short);
+	debugfs_create_u32("fault_delay_us", 0600, dbg->dir,
+			   &dbg->fault_delay_us);
+	debugfs_create_u64("fault_injected", 0444, dbg->dir,
+			   &dbg->fault_injected);
+
+	chip->debug = dbg;
+	return 0;
+}
+
+/* call after the urbs are stopped */
+void zoom_debug_free(struct zoom_chip *chip)
+{
+	struct zoom_debug *dbg = chip->debug;
+
+	if (!dbg)
+		return;
+
+	spin_lock_irq(&dbg->lock);
+	dbg->dead = true;
+	dbg->log_enabled = false;
+	dbg->replay_armed = false;
+	dbg->fault_every = 0;
+	spin_unlock_irq(&dbg->lock);
+	wake_up_interruptible_all(&dbg->log_wait);
+
+	debugfs_remove_recursive(dbg->dir);
+	chip->debug = NULL;
+	kref_put(&dbg->kref, zoom_debug_release_kref);
+}
+
+void zoom_debug_module_init(void)
+{
+	zoom_debugfs_root = debugfs_create_dir(KBUILD_MODNAME, NULL);
+}
+
+void zoom_debug_module_exit(void)
+{
+	debugfs_remove_recursive(zoom_debugfs_root);
+}
@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#ifndef ZOOM_DEBUG_H
+#define ZOOM_DEBUG_H
+
+#include <linux/types.h>
+
+struct urb;
+struct zoom_chip;
+
+void zoom_debug_module_init(void);
+void zoom_debug_module_exit(void);
+int zoom_debug_init(struct zoom_chip *chip);
+void zoom_debug_free(struct zoom_chip *chip);
+
+bool zoom_debug_replay_in(struct zoom_chip *chip, struct urb *urb);
+bool zoom_debug_fault(struct zoom_chip *chip, struct urb *urb, u8 dir);
+void zoom_debug_log_urb(struct zoom_chip *chip, struct urb *urb, u8 dir,
+			u64 tstamp_ns);
+#endif /* ZOOM_DEBUG_H */
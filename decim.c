@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * Decimation by 3 for the low rate capture PCM
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#include <linux/minmax.h>
+#include <linux/string.h>
+
+#include "decim.h"
+
+/*
+ * First half of the lowpass, Q15, sum 1.0: Kaiser windowed sinc (beta 7)
+ * with the cutoff at 7.8 kHz of 48 kHz. Flat within 0.2 dB up to 7 kHz,
+ * at least 71 dB down from 9 kHz on, so aliases stay out of the 0-7 kHz
+ * band of the 16 kHz output.
+ */
+static const s16 zoom_decim_fir[ZOOM_DECIM_TAPS / 2] = {
+	-1, -1, 2, 4, 2, -4, -10, -6,
+	8, 20, 13, -12, -35, -26, 17, 56,
+	45, -21, -85, -75, 23, 124, 118, -20,
+	-173, -179, 9, 236, 264, 13, -315, -384,
+	-56, 415, 555, 130, -549, -815, -261, 750,
+	1258, 523, -1124, -2236, -1226, 2297, 6926, 10190,
+};
+
+void zoom_decim_reset(struct zoom_decim *d, unsigned int channels)
+{
+	memset(d, 0, sizeof(*d));
+	d->channels = min_t(unsigned int, channels, ZOOM_MAX_SLOTS);
+}
+
+/*
+ * One input frame (usb frame, channel c in slot slot_map[c]) into the
+ * history. Returns true every ZOOM_DECIM_FACTOR frames, when an output
+ * frame is due. Only those are computed, the polyphase way.
+ */
+bool zoom_decim_push(struct zoom_decim *d, const __le32 *frame,
+		     const u8 *slot_map)
+{
+	unsigned int c;
+	s32 s;
+
+	for (c = 0; c < d->channels; c++) {
+		s = le32_to_cpu(frame[slot_map[c]]);
+		d->hist[c][d->pos] = s;
+		d->hist[c][d->pos + ZOOM_DECIM_TAPS] = s;
+	}
+	if (++d->pos == ZOOM_DECIM_TAPS)
+		d->pos = 0;
+
+	if (++d->phase < ZOOM_DECIM_FACTOR)
+		return false;
+	d->phase = 0;
+	return true;
+}
+
+/* one output frame, S32_LE or S16_LE interleaved */
+void zoom_decim_out(const struct zoom_decim *d, void *dest,
+		    snd_pcm_format_t format)
+{
+	unsigned int c, k;
+	const s32 *x;
+	s64 acc;
+	s32 s;
+
+	for (c = 0; c < d->channels; c++) {
+		x = &d->hist[c][d->pos]; /* the last ZOOM_DECIM_TAPS samples */
+		acc = 0;
+		/* symmetric, one multiply per pair */
+		for (k = 0; k < ZOOM_DECIM_TAPS / 2; k++)
+			acc += (s64)zoom_decim_fir[k] *
+			       ((s64)x[k] + x[ZOOM_DECIM_TAPS - 1 - k]);
+		s = clamp_t(s64, acc >> 15, S32_MIN, S32_MAX);
+
+		if (format == SNDRV_PCM_FORMAT_S16_LE)
+			((__le16 *)dest)[c] = cpu_to_le16((u32)s >> 16);
+		else
+			((__le32 *)dest)[c] = cpu_to_le32(s);
+	}
+}
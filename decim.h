@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#ifndef ZOOM_DECIM_H
+#define ZOOM_DECIM_H
+
+#include <linux/types.h>
+#include <sound/pcm.h>
+
+#include "driver.h"
+
+#define ZOOM_DECIM_FACTOR 3  /* 48 kHz -> 16 kHz */
+#define ZOOM_DECIM_TAPS   96 /* symmetric lowpass FIR */
+
+/* FIR history of the selected channels, each sample stored twice */
+struct zoom_decim {
+	unsigned int channels;
+	unsigned int pos;   /* oldest sample of the window */
+	unsigned int phase; /* input frames since the last output */
+	s32 hist[ZOOM_MAX_SLOTS][2 * ZOOM_DECIM_TAPS];
+};
+
+void zoom_decim_reset(struct zoom_decim *d, unsigned int channels);
+bool zoom_decim_push(struct zoom_decim *d, const __le32 *frame,
+		     const u8 *slot_map);
+void zoom_decim_out(const struct zoom_decim *d, void *dest,
+		    snd_pcm_format_t format);
+#endif /* ZOOM_DECIM_H */
@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 /*
- * Linux driver for ZOOM devices (L-8 only at the moment)
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
  *
  * Copyright 2021 (C) Sebastian Reimers
  *
@@ -8,15 +8,25 @@
  *
  */
 
+#include <linux/ctype.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/version.h>
 #include <sound/initval.h>
 
 #include "driver.h"
 #include "pcm.h"
+#include "pack.h"
+#include "rawdev.h"
+#include "debug.h"
+#include "control.h"
+#include "hwdep.h"
+#include "timer.h"
 
 MODULE_AUTHOR("Sebastian Reimers <hallo@studio-link.de>");
-MODULE_DESCRIPTION("ZOOM L-8 USB audio driver");
+MODULE_DESCRIPTION("ZOOM LiveTrak USB audio driver");
 MODULE_LICENSE("GPL");
 
 static int index[SNDRV_CARDS] = SNDRV_DEFAULT_IDX; /* Index 0-max */
@@ -24,7 +34,7 @@ static char *id[SNDRV_CARDS] = SNDRV_DEFAULT_STR; /* Id for card */
 static bool enable[SNDRV_CARDS] = SNDRV_DEFAULT_ENABLE_PNP; /* Enable this card */
 
 #define DRIVER_NAME "snd-usb-zoom"
-#define CARD_NAME "ZOOM L-8"
+#define CARD_NAME "ZOOM LiveTrak"
 
 module_param_array(index, int, NULL, 0444);
 MODULE_PARM_DESC(index, "Index value for " CARD_NAME " soundcard.");
@@ -33,38 +43,235 @@ MODULE_PARM_DESC(id, "ID string for " CARD_NAME " soundcard.");
 module_param_array(enable, bool, NULL, 0444);
 MODULE_PARM_DESC(enable, "Enable " CARD_NAME " soundcard.");
 
+static bool untested_models;
+module_param(untested_models, bool, 0444);
+MODULE_PARM_DESC(untested_models, "Also bind the L-12 and L-20 (layout not verified).");
+
+static unsigned int resume_secs = 60;
+module_param(resume_secs, uint, 0644);
+MODULE_PARM_DESC(resume_secs, "Seconds a replugged device gets its settings back.");
+
+/*
+ * A device by serial number (or usb port without one) keeps its card
+ * number and id over replugging, for the module lifetime. The settings of
+ * the last disconnect are restored within resume_secs.
+ */
+struct zoom_identity {
+	char key[64];          /* "" if unused */
+	bool connected;
+	int number;            /* alsa card number, -1 before registration */
+	unsigned long saved;   /* jiffies of the disconnect, 0: nothing saved */
+	struct zoom_pcm_state pcm;
+	unsigned int timer_frames;
+};
+
+/* only protects the slot and identity allocation, probes run in parallel
+ * otherwise */
 static DEFINE_MUTEX(register_mutex);
+static bool slot_used[SNDRV_CARDS];
+static struct zoom_identity identities[SNDRV_CARDS];
+
+static const unsigned int zoom_rates_48k[] = { 48000 };
+
+/* Out1..Out4 (USB 1..4), identical on all LiveTrak models */
+static const u8 zoom_out_slots[] = { 0, 1, 2, 3 };
 
-struct zoom_vendor_quirk {
-	const char *device_name;
+/* Master L/R, In1..In6, In7L/R, In8L/R (see README) */
+static const u8 zoom_l8_in_slots[] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11
 };
 
+/* Master L/R, In1..In8, In9/10 L/R, In11/12 L/R */
+static const u8 zoom_l12_in_slots[] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13
+};
+
+/* Master L/R, In1..In16, In17/18 L/R, In19/20 L/R */
+static const u8 zoom_l20_in_slots[] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19,
+	20, 21
+};
+
+#define ZOOM_LIVETRAK_MODEL(_name, _id, _in_slots, _untested)	\
+	{							\
+		.name = _name,					\
+		.id = _id,					\
+		.untested = _untested,				\
+		.slots = ZOOM_MAX_SLOTS,			\
+		.in_channels = ARRAY_SIZE(_in_slots),		\
+		.out_channels = ARRAY_SIZE(zoom_out_slots),	\
+		.in_slots = _in_slots,				\
+		.out_slots = zoom_out_slots,			\
+		.out_ifnum = 1, .out_alt = 3,			\
+		.in_ifnum = 2, .in_alt = 3,			\
+		.rates = zoom_rates_48k,			\
+		.n_rates = ARRAY_SIZE(zoom_rates_48k),		\
+	}
+
+static const struct zoom_model zoom_l8 =
+	ZOOM_LIVETRAK_MODEL("ZOOM L-8", "L8", zoom_l8_in_slots, false);
+static const struct zoom_model zoom_l12 =
+	ZOOM_LIVETRAK_MODEL("ZOOM L-12", "L12", zoom_l12_in_slots, true);
+static const struct zoom_model zoom_l20 =
+	ZOOM_LIVETRAK_MODEL("ZOOM L-20", "L20", zoom_l20_in_slots, true);
+
+/* first enabled and unused module parameter slot */
+static int zoom_slot_get(void)
+{
+	int i;
+
+	mutex_lock(&register_mutex);
+	for (i = 0; i < SNDRV_CARDS; i++) {
+		if (enable[i] && !slot_used[i]) {
+			slot_used[i] = true;
+			break;
+		}
+	}
+	mutex_unlock(&register_mutex);
+
+	return i < SNDRV_CARDS ? i : -ENODEV;
+}
+
+static void zoom_slot_put(int idx)
+{
+	mutex_lock(&register_mutex);
+	slot_used[idx] = false;
+	mutex_unlock(&register_mutex);
+}
+
+/*
+ * The identity of a device: same model and serial, or the same port if it
+ * has none. Returns a free entry (or the oldest disconnected one) for new
+ * devices. With `restore`, the saved settings are still fresh.
+ */
+static struct zoom_identity *zoom_identity_get(struct usb_device *device,
+					       const struct zoom_model *model,
+					       bool *restore)
+{
+	struct zoom_identity *id, *oldest = NULL;
+	char key[sizeof(id->key)];
+	int i;
+
+	*restore = false;
+	if (device->serial && *device->serial)
+		snprintf(key, sizeof(key), "%s s%s", model->id, device->serial);
+	else
+		snprintf(key, sizeof(key), "%s p%s", model->id,
+			 dev_name(&device->dev));
+
+	mutex_lock(&register_mutex);
+	for (i = 0; i < SNDRV_CARDS; i++) {
+		id = &identities[i];
+		if (!strcmp(id->key, key) && !id->connected)
+			break;
+		if (id->connected)
+			continue;
+		if (!oldest || !id->key[0] ||
+		    (oldest->key[0] && time_before(id->saved, oldest->saved)))
+			oldest = id;
+	}
+	if (i == SNDRV_CARDS) {
+		id = oldest;
+		if (id) {
+			memset(id, 0, sizeof(*id));
+			strscpy(id->key, key, sizeof(id->key));
+			id->number = -1;
+		}
+	}
+	if (id) {
+		id->connected = true;
+		*restore = id->saved && time_before(jiffies, id->saved +
+						    resume_secs * HZ);
+	}
+	mutex_unlock(&register_mutex);
+	return id;
+}
+
+/* saves the settings of `chip` at disconnect, NULL at probe errors */
+static void zoom_identity_put(struct zoom_identity *id,
+			      struct zoom_chip *chip)
+{
+	mutex_lock(&register_mutex);
+	if (chip) {
+		zoom_pcm_save(chip, &id->pcm);
+		id->timer_frames = zoom_timer_get_frames(chip);
+		id->saved = jiffies ?: 1;
+	} else {
+		id->saved = 0;
+	}
+	id->connected = false;
+	mutex_unlock(&register_mutex);
+}
+
+/* "L8" and the last characters of the serial or port: L8s1A2B3C4D */
+static void zoom_identity_card_id(const struct zoom_identity *id,
+				  char *buf, size_t size)
+{
+	const char *src = id->key;
+	size_t len = 0, skip;
+	char alnum[sizeof(id->key)];
+
+	for (; *src; src++)
+		if (isalnum(*src))
+			alnum[len++] = *src;
+	alnum[len] = 0;
+
+	/* keep the model prefix, cut the serial from the front */
+	skip = strcspn(id->key, " ");
+	if (len >= size)
+		memmove(alnum + skip, alnum + skip + len - (size - 1),
+			size - skip);
+	strscpy(buf, alnum, size);
+}
+
+/* the slot is in use until the card is gone, open files included */
+static void zoom_card_free(struct snd_card *card)
+{
+	struct zoom_chip *chip = card->private_data;
+
+	if (chip->identity) /* only if the probe failed */
+		zoom_identity_put(chip->identity, NULL);
+	zoom_slot_put(chip->index);
+}
+
 static int zoom_chip_create(struct usb_interface *intf,
 			      struct usb_device *device, int idx,
-			      const struct zoom_vendor_quirk *quirk,
+			      const struct zoom_model *model,
+			      struct zoom_identity *identity,
 			      struct zoom_chip **rchip)
 {
 	struct snd_card *card = NULL;
 	struct zoom_chip *chip;
+	int number = index[idx];
+	char card_id[sizeof(card->id)];
 	int ret;
 	int len;
 
 	*rchip = NULL;
 
+	/* the card number of the last time, unless the parameter says */
+	if (number < 0 && identity && identity->number >= 0)
+		number = identity->number;
+
 	/* if we are here, card can be registered in alsa. */
-	ret = snd_card_new(&intf->dev, index[idx], id[idx], THIS_MODULE,
+	ret = snd_card_new(&intf->dev, number, id[idx], THIS_MODULE,
 			   sizeof(*chip), &card);
+	if (ret == -EBUSY && number != index[idx]) /* old card still open */
+		ret = snd_card_new(&intf->dev, index[idx], id[idx],
+				   THIS_MODULE, sizeof(*chip), &card);
 	if (ret < 0) {
 		dev_err(&device->dev, "cannot create alsa card.\n");
 		return ret;
 	}
 
+	if (!id[idx] && identity) {
+		zoom_identity_card_id(identity, card_id, sizeof(card_id));
+		snd_card_set_id(card, card_id);
+	}
+
 	strscpy(card->driver, DRIVER_NAME, sizeof(card->driver));
 
-	if (quirk && quirk->device_name)
-		strscpy(card->shortname, quirk->device_name, sizeof(card->shortname));
-	else
-		strscpy(card->shortname, "Zoom generic audio", sizeof(card->shortname));
+	strscpy(card->shortname, model->name, sizeof(card->shortname));
 
 	strlcat(card->longname, card->shortname, sizeof(card->longname));
 	len = strlcat(card->longname, " at ", sizeof(card->longname));
@@ -75,6 +282,10 @@ static int zoom_chip_create(struct usb_interface *intf,
 	chip = card->private_data;
 	chip->dev = device;
 	chip->card = card;
+	chip->index = idx;
+	chip->model = model;
+	chip->identity = identity;
+	card->private_free = zoom_card_free;
 
 	*rchip = chip;
 	return 0;
@@ -83,7 +294,10 @@ static int zoom_chip_create(struct usb_interface *intf,
 static int zoom_chip_probe(struct usb_interface *intf,
 			     const struct usb_device_id *usb_id)
 {
-	const struct zoom_vendor_quirk *quirk = (struct zoom_vendor_quirk *)usb_id->driver_info;
+	const struct zoom_model *model = (struct zoom_model *)usb_id->driver_info;
+	ktime_t start = ktime_get();
+	struct zoom_identity *identity;
+	bool restore;
 	int ret;
 	int i;
 	struct zoom_chip *chip;
@@ -101,24 +315,30 @@ static int zoom_chip_probe(struct usb_interface *intf,
 	dev_info(&device->dev, "zoom chip CT2: %d\n", ret);
 #endif
 
-	/* check whether the card is already registered */
-	chip = NULL;
-	mutex_lock(&register_mutex);
-
-	for (i = 0; i < SNDRV_CARDS; i++)
-		if (enable[i])
-			break;
+	/* leave the device to other drivers unless asked for */
+	if (model->untested && !untested_models) {
+		dev_info(&device->dev,
+			 "%s not verified, load with untested_models=1\n",
+			 model->name);
+		return -ENODEV;
+	}
 
-	if (i >= SNDRV_CARDS) {
+	i = zoom_slot_get();
+	if (i < 0) {
 		dev_err(&device->dev, "no available " CARD_NAME " audio device\n");
-		ret = -ENODEV;
-		goto err;
+		return i;
 	}
 
-	ret = zoom_chip_create(intf, device, i, quirk, &chip);
+	identity = zoom_identity_get(device, model, &restore);
+
+	/* from here the slot and identity are released with the card */
+	ret = zoom_chip_create(intf, device, i, model, identity, &chip);
 	if (ret < 0) {
 		dev_err(&device->dev, "zoom_chip_create\n");
-		goto err;
+		if (identity)
+			zoom_identity_put(identity, NULL);
+		zoom_slot_put(i);
+		return ret;
 	}
 
 	ret = zoom_pcm_init(chip);
@@ -127,21 +347,70 @@ static int zoom_chip_probe(struct usb_interface *intf,
 		goto err_chip_destroy;
 	}
 
+	ret = zoom_control_init(chip);
+	if (ret < 0) {
+		dev_err(&device->dev, "zoom_control_init\n");
+		goto err_chip_destroy;
+	}
+
+	ret = zoom_hwdep_init(chip);
+	if (ret < 0) {
+		dev_err(&device->dev, "zoom_hwdep_init\n");
+		goto err_chip_destroy;
+	}
+
+	ret = zoom_timer_init(chip);
+	if (ret < 0) {
+		dev_err(&device->dev, "zoom_timer_init\n");
+		goto err_chip_destroy;
+	}
+
+	/* replugged: settings and learned urb depth of the last time */
+	if (restore) {
+		zoom_pcm_restore(chip, &identity->pcm);
+		zoom_timer_set_frames(chip, identity->timer_frames);
+		dev_info(&device->dev, "restored the settings of %s\n",
+			 chip->card->id);
+	}
+
+	ret = zoom_debug_init(chip);
+	if (ret < 0) {
+		dev_err(&device->dev, "zoom_debug_init\n");
+		goto err_chip_destroy;
+	}
+
+	ret = zoom_raw_init(chip);
+	if (ret < 0) {
+		dev_err(&device->dev, "zoom_raw_init\n");
+		goto err_debug_destroy;
+	}
+
 	ret = snd_card_register(chip->card);
 	if (ret < 0) {
 		dev_err(&device->dev, "cannot register " CARD_NAME " card\n");
-		goto err_chip_destroy;
+		goto err_raw_destroy;
 	}
 
-	mutex_unlock(&register_mutex);
+	if (identity) {
+		mutex_lock(&register_mutex);
+		identity->number = chip->card->number;
+		mutex_unlock(&register_mutex);
+	}
 
 	usb_set_intfdata(intf, chip);
+	dev_info(&device->dev, "%s registered as card %d in %lld us\n",
+		 model->name, chip->card->number,
+		 ktime_us_delta(ktime_get(), start));
 	return 0;
 
+err_raw_destroy:
+	/* /dev/zoomN is live, a reader may have started the stream */
+	zoom_pcm_abort(chip);
+	zoom_raw_disconnect(chip);
+err_debug_destroy:
+	zoom_debug_free(chip);
 err_chip_destroy:
 	snd_card_free(chip->card);
-err:
-	mutex_unlock(&register_mutex);
 	return ret;
 }
 
@@ -160,15 +429,31 @@ static void zoom_chip_disconnect(struct usb_interface *intf)
 	snd_card_disconnect(card);
 
 	zoom_pcm_abort(chip);
+	if (chip->identity) {
+		zoom_identity_put(chip->identity, chip);
+		chip->identity = NULL;
+	}
+	zoom_raw_disconnect(chip);
+	zoom_debug_free(chip);
 	snd_card_free_when_closed(card);
 }
 
+/*
+ * adding a model: describe its layout above and add its id here, untested
+ * until the id and the slot layout are confirmed on a device
+ */
 static const struct usb_device_id device_table[] = {
 	{
 		USB_DEVICE_INTERFACE_NUMBER(0x1686, 0x0525, 2),
-		.driver_info = (unsigned long)&(const struct zoom_vendor_quirk) {
-			.device_name = "ZOOM L-8"
-		}
+		.driver_info = (unsigned long)&zoom_l8
+	},
+	{
+		USB_DEVICE_INTERFACE_NUMBER(0x1686, 0x0519, 2),
+		.driver_info = (unsigned long)&zoom_l12
+	},
+	{
+		USB_DEVICE_INTERFACE_NUMBER(0x1686, 0x0517, 2),
+		.driver_info = (unsigned long)&zoom_l20
 	},
 	{}
 };
@@ -180,6 +465,35 @@ static struct usb_driver zoom_usb_driver = {
 	.probe = zoom_chip_probe,
 	.disconnect = zoom_chip_disconnect,
 	.id_table = device_table,
+	/* probes of several devices (boot, hub) don't wait for each other */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#else
+	.drvwrap.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#endif
 };
 
-module_usb_driver(zoom_usb_driver);
+static int __init zoom_init(void)
+{
+	int ret;
+
+	ret = zoom_pack_init();
+	if (ret < 0)
+		return ret;
+
+	zoom_debug_module_init();
+
+	ret = usb_register(&zoom_usb_driver);
+	if (ret < 0)
+		zoom_debug_module_exit();
+	return ret;
+}
+
+static void __exit zoom_exit(void)
+{
+	usb_deregister(&zoom_usb_driver);
+	zoom_debug_module_exit();
+}
+
+module_init(zoom_init);
+module_exit(zoom_exit);
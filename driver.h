@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 /*
- * Linux driver for ZOOM devices (L-8 only at the moment)
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
  *
  * Copyright 2021 (C) Sebastian Reimers
  *
@@ -14,11 +14,54 @@
 #include <linux/usb.h>
 #include <sound/core.h>
 
+#define ZOOM_MAX_SLOTS 32 /* 32 Bit slots per USB frame */
+#define ZOOM_URB_SIZE_MAX 4096
+
 struct pcm_runtime;
+struct zoom_raw;
+struct zoom_debug;
+struct zoom_timer;
+struct zoom_identity;
+struct snd_kcontrol;
+
+/* per model USB layout, see device_table in driver.c */
+struct zoom_model {
+	const char *name;
+	const char *id; /* card id prefix, alphanumeric */
+
+	unsigned int slots;        /* slots per frame (live and padding) */
+	unsigned int in_channels;  /* live capture slots */
+	unsigned int out_channels; /* live playback slots */
+	const u8 *in_slots;        /* frame slot of each capture channel */
+	const u8 *out_slots;       /* frame slot of each playback channel */
+
+	/* streaming interfaces, the alt setting is only used if the
+	 * descriptors don't tell which one is 32 bit */
+	u8 out_ifnum, out_alt;
+	u8 in_ifnum, in_alt;
+
+	const unsigned int *rates;
+	unsigned int n_rates;
+
+	bool untested; /* ids and layout not verified on a device */
+};
 
 struct zoom_chip {
 	struct usb_device *dev;
 	struct snd_card *card;
+	int index; /* slot in the index/id/enable module parameters */
+	struct zoom_identity *identity; /* survives replugging */
+	const struct zoom_model *model;
 	struct pcm_runtime *pcm;
+	struct zoom_raw *raw; /* /dev/zoomN */
+	struct zoom_debug *debug;
+	struct zoom_timer *timer; /* snd_timer on the capture clock */
+	struct snd_kcontrol *profile_ctl; /* "Latency Profile" */
+	struct snd_kcontrol *activity_ctl; /* "Capture Activity" */
 };
+
+static inline unsigned int zoom_frame_bytes(const struct zoom_model *model)
+{
+	return model->slots * 4; /* 32Bit */
+}
 #endif /* ZOOM_CHIP_H */
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * hwdep device: scheduled stream start, see uapi.h
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#include <linux/uaccess.h>
+#include <sound/core.h>
+#include <sound/hwdep.h>
+
+#include "driver.h"
+#include "hwdep.h"
+#include "pcm.h"
+#include "uapi.h"
+
+static int zoom_hwdep_ioctl(struct snd_hwdep *hw, struct file *file,
+			    unsigned int cmd, unsigned long arg)
+{
+	struct zoom_chip *chip = hw->private_data;
+	void __user *argp = (void __user *)arg;
+	struct zoom_sched sched;
+
+	switch (cmd) {
+	case ZOOM_IOCTL_SCHED_START:
+		if (copy_from_user(&sched, argp, sizeof(sched)))
+			return -EFAULT;
+		return zoom_pcm_sched_arm(chip, sched.streams, sched.start_ns);
+
+	case ZOOM_IOCTL_SCHED_STATUS:
+		zoom_pcm_sched_status(chip, &sched);
+		if (copy_to_user(argp, &sched, sizeof(sched)))
+			return -EFAULT;
+		return 0;
+
+	default:
+		return -ENOTTY;
+	}
+}
+
+/* call before snd_card_register(), freed with the card */
+int zoom_hwdep_init(struct zoom_chip *chip)
+{
+	struct snd_hwdep *hw;
+	int ret;
+
+	ret = snd_hwdep_new(chip->card, "ZOOM", 0, &hw);
+	if (ret < 0)
+		return ret;
+
+	strscpy(hw->name, "ZOOM LiveTrak scheduled start", sizeof(hw->name));
+	hw->private_data = chip;
+	hw->ops.ioctl = zoom_hwdep_ioctl;
+	hw->ops.ioctl_compat = zoom_hwdep_ioctl; /* same layout */
+	return 0;
+}
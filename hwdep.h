@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#ifndef ZOOM_HWDEP_H
+#define ZOOM_HWDEP_H
+
+struct zoom_chip;
+
+int zoom_hwdep_init(struct zoom_chip *chip);
+#endif /* ZOOM_HWDEP_H */
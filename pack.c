@@ -0,0 +1,623 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#ifdef __KERNEL__
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/random.h>
+#ifdef CONFIG_X86
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+#include <asm/simd.h>
+#endif
+#endif
+
+#include "pack.h"
+
+/* userspace builds declare the vector registers the asm below uses */
+#ifndef ZOOM_XMM_CLOBBERS
+#define ZOOM_XMM_CLOBBERS
+#endif
+
+static void zoom_unpack_scalar(u32 *dest, const u32 *src, unsigned int frames,
+			       unsigned int slots, unsigned int first,
+			       unsigned int channels)
+{
+	unsigned int i, c;
+
+	src += first;
+	for (i = 0; i < frames; i++) {
+		for (c = 0; c < channels; c++)
+			dest[c] = src[c];
+		dest += channels;
+		src += slots;
+	}
+}
+
+static void zoom_pack_scalar(u32 *dest, const u32 *src, unsigned int frames,
+			     unsigned int slots, unsigned int first,
+			     unsigned int channels)
+{
+	unsigned int i, c;
+
+	for (i = 0; i < frames; i++) {
+		memset(dest, 0, slots * 4); /* Padding */
+		for (c = 0; c < channels; c++)
+			dest[first + c] = src[c];
+		dest += slots;
+		src += channels;
+	}
+}
+
+static const struct zoom_pack_ops zoom_pack_scalar_ops = {
+	.name = "scalar",
+	.unpack = zoom_unpack_scalar,
+	.pack = zoom_pack_scalar,
+	.simd = false,
+};
+
+#ifdef CONFIG_X86
+/*
+ * The kernel is built without SSE code generation, so nothing but these
+ * statements touches the vector registers between kernel_fpu_begin() and
+ * kernel_fpu_end() (same as lib/raid6). Each statement stands alone.
+ */
+#define SSE2_COPY16(d, s)						\
+	asm volatile("movdqu %1, %%xmm0\n\t"				\
+		     "movdqu %%xmm0, %0"				\
+		     : "=m" (*(d)) : "m" (*(s)) : "memory" ZOOM_XMM_CLOBBERS)
+#define SSE2_ZERO16(d)							\
+	asm volatile("pxor %%xmm1, %%xmm1\n\t"				\
+		     "movdqu %%xmm1, %0"				\
+		     : "=m" (*(d)) : : "memory" ZOOM_XMM_CLOBBERS)
+
+#define AVX2_COPY32(d, s)						\
+	asm volatile("vmovdqu %1, %%ymm0\n\t"				\
+		     "vmovdqu %%ymm0, %0"				\
+		     : "=m" (*(d)) : "m" (*(s)) : "memory" ZOOM_XMM_CLOBBERS)
+#define AVX2_ZERO32(d)							\
+	asm volatile("vpxor %%ymm1, %%ymm1, %%ymm1\n\t"			\
+		     "vmovdqu %%ymm1, %0"				\
+		     : "=m" (*(d)) : : "memory" ZOOM_XMM_CLOBBERS)
+/* VEX encoded, legacy SSE after touching ymm costs a state transition */
+#define AVX_COPY16(d, s)						\
+	asm volatile("vmovdqu %1, %%xmm0\n\t"				\
+		     "vmovdqu %%xmm0, %0"				\
+		     : "=m" (*(d)) : "m" (*(s)) : "memory" ZOOM_XMM_CLOBBERS)
+
+static void zoom_unpack_sse2(u32 *dest, const u32 *src, unsigned int frames,
+			     unsigned int slots, unsigned int first,
+			     unsigned int channels)
+{
+	unsigned int i, c;
+
+	src += first;
+	for (i = 0; i < frames; i++) {
+		for (c = 0; c + 4 <= channels; c += 4)
+			SSE2_COPY16(dest + c, src + c);
+		for (; c < channels; c++)
+			dest[c] = src[c];
+		dest += channels;
+		src += slots;
+	}
+}
+
+static void zoom_pack_sse2(u32 *dest, const u32 *src, unsigned int frames,
+			   unsigned int slots, unsigned int first,
+			   unsigned int channels)
+{
+	unsigned int i, c;
+
+	for (i = 0; i < frames; i++) {
+		for (c = 0; c + 4 <= slots; c += 4)
+			SSE2_ZERO16(dest + c);
+		for (; c < slots; c++)
+			dest[c] = 0;
+
+		for (c = 0; c + 4 <= channels; c += 4)
+			SSE2_COPY16(dest + first + c, src + c);
+		for (; c < channels; c++)
+			dest[first + c] = src[c];
+		dest += slots;
+		src += channels;
+	}
+}
+
+static bool zoom_pack_sse2_usable(void)
+{
+	return boot_cpu_has(X86_FEATURE_XMM2);
+}
+
+static const struct zoom_pack_ops zoom_pack_sse2_ops = {
+	.name = "sse2",
+	.unpack = zoom_unpack_sse2,
+	.pack = zoom_pack_sse2,
+	.simd = true,
+	.usable = zoom_pack_sse2_usable,
+};
+
+static void zoom_unpack_avx2(u32 *dest, const u32 *src, unsigned int frames,
+			     unsigned int slots, unsigned int first,
+			     unsigned int channels)
+{
+	unsigned int i, c;
+
+	src += first;
+	for (i = 0; i < frames; i++) {
+		for (c = 0; c + 8 <= channels; c += 8)
+			AVX2_COPY32(dest + c, src + c);
+		if (c + 4 <= channels) {
+			AVX_COPY16(dest + c, src + c);
+			c += 4;
+		}
+		for (; c < channels; c++)
+			dest[c] = src[c];
+		dest += channels;
+		src += slots;
+	}
+	asm volatile("vzeroupper" : : : "memory" ZOOM_XMM_CLOBBERS);
+}
+
+static void zoom_pack_avx2(u32 *dest, const u32 *src, unsigned int frames,
+			   unsigned int slots, unsigned int first,
+			   unsigned int channels)
+{
+	unsigned int i, c;
+
+	for (i = 0; i < frames; i++) {
+		for (c = 0; c + 8 <= slots; c += 8)
+			AVX2_ZERO32(dest + c);
+		for (; c < slots; c++)
+			dest[c] = 0;
+
+		for (c = 0; c + 8 <= channels; c += 8)
+			AVX2_COPY32(dest + first + c, src + c);
+		if (c + 4 <= channels) {
+			AVX_COPY16(dest + first + c, src + c);
+			c += 4;
+		}
+		for (; c < channels; c++)
+			dest[first + c] = src[c];
+		dest += slots;
+		src += channels;
+	}
+	asm volatile("vzeroupper" : : : "memory" ZOOM_XMM_CLOBBERS);
+}
+
+static bool zoom_pack_avx2_usable(void)
+{
+	return boot_cpu_has(X86_FEATURE_AVX) && boot_cpu_has(X86_FEATURE_AVX2);
+}
+
+static const struct zoom_pack_ops zoom_pack_avx2_ops = {
+	.name = "avx2",
+	.unpack = zoom_unpack_avx2,
+	.pack = zoom_pack_avx2,
+	.simd = true,
+	.usable = zoom_pack_avx2_usable,
+};
+
+static bool zoom_simd_begin(void)
+{
+	if (!may_use_simd())
+		return false;
+	kernel_fpu_begin();
+	return true;
+}
+
+static void zoom_simd_end(void)
+{
+	kernel_fpu_end();
+}
+#else
+static bool zoom_simd_begin(void)
+{
+	return false;
+}
+
+static void zoom_simd_end(void)
+{
+}
+#endif /* CONFIG_X86 */
+
+/* best first */
+static const struct zoom_pack_ops *const zoom_pack_algos[] = {
+#ifdef CONFIG_X86
+	&zoom_pack_avx2_ops,
+	&zoom_pack_sse2_ops,
+#endif
+	&zoom_pack_scalar_ops,
+};
+
+static const struct zoom_pack_ops *zoom_pack_ops = &zoom_pack_scalar_ops;
+
+/*
+ * The selected SIMD kernel, if the urb is large enough and the FPU may be
+ * used here. Returns false if the caller has to copy.
+ */
+static bool zoom_pack_simd(bool pack, u32 *dest, const u32 *src,
+			   unsigned int frames, unsigned int slots,
+			   unsigned int first, unsigned int channels)
+{
+	const struct zoom_pack_ops *ops = zoom_pack_ops;
+
+	if (!ops->simd || frames < ZOOM_PACK_SIMD_FRAMES || channels < 4 ||
+	    !zoom_simd_begin())
+		return false;
+	if (pack)
+		ops->pack(dest, src, frames, slots, first, channels);
+	else
+		ops->unpack(dest, src, frames, slots, first, channels);
+	zoom_simd_end();
+	return true;
+}
+
+/*
+ * Copy routines specialised per channel count and sample format, the
+ * compiler unrolls the channel loop. S16 uses the upper half of a slot.
+ */
+#define PLAN_CHANNELS(x)						\
+	x(1) x(2) x(3) x(4) x(5) x(6) x(7) x(8) x(9) x(10) x(11) x(12)	\
+	x(13) x(14) x(15) x(16) x(17) x(18) x(19) x(20) x(21) x(22)	\
+	x(23) x(24)
+
+#define PLAN_DEFINE_COPY(name, n)					\
+static void zoom_unpack_s32_##name(const struct zoom_plan *plan,	\
+				   void *pcm, __le32 *urb,		\
+				   unsigned int frames)			\
+{									\
+	__le32 *dest = pcm;						\
+	unsigned int i, c;						\
+									\
+	for (i = 0; i < frames; i++, dest += (n), urb += plan->slots)	\
+		for (c = 0; c < (n); c++)				\
+			dest[c] = urb[plan->slot_map[c]];		\
+}									\
+									\
+static void zoom_unpack_s16_##name(const struct zoom_plan *plan,	\
+				   void *pcm, __le32 *urb,		\
+				   unsigned int frames)			\
+{									\
+	__le16 *dest = pcm;						\
+	unsigned int i, c;						\
+									\
+	for (i = 0; i < frames; i++, dest += (n), urb += plan->slots)	\
+		for (c = 0; c < (n); c++)				\
+			dest[c] = cpu_to_le16(le32_to_cpu(		\
+				urb[plan->slot_map[c]]) >> 16);		\
+}									\
+									\
+static void zoom_pack_s32_##name(const struct zoom_plan *plan,		\
+				 void *pcm, __le32 *urb,		\
+				 unsigned int frames)			\
+{									\
+	const __le32 *src = pcm;					\
+	unsigned int i, c;						\
+									\
+	for (i = 0; i < frames; i++, src += (n), urb += plan->slots) {	\
+		memset(urb, 0, plan->urb_frame_bytes); /* Padding */	\
+		for (c = 0; c < (n); c++)				\
+			urb[plan->slot_map[c]] = src[c];		\
+	}								\
+}									\
+									\
+static void zoom_pack_s16_##name(const struct zoom_plan *plan,		\
+				 void *pcm, __le32 *urb,		\
+				 unsigned int frames)			\
+{									\
+	const __le16 *src = pcm;					\
+	unsigned int i, c;						\
+									\
+	for (i = 0; i < frames; i++, src += (n), urb += plan->slots) {	\
+		memset(urb, 0, plan->urb_frame_bytes); /* Padding */	\
+		for (c = 0; c < (n); c++)				\
+			urb[plan->slot_map[c]] = cpu_to_le32(		\
+				(u32)le16_to_cpu(src[c]) << 16);	\
+	}								\
+}
+
+#define PLAN_DEFINE_COPY_N(n) PLAN_DEFINE_COPY(n, n)
+PLAN_CHANNELS(PLAN_DEFINE_COPY_N)
+PLAN_DEFINE_COPY(generic, plan->channels)
+
+struct zoom_copy_set {
+	zoom_copy_fn unpack_s32, unpack_s16;
+	zoom_copy_fn pack_s32, pack_s16;
+};
+
+#define PLAN_COPY_SET(name) {						\
+	zoom_unpack_s32_##name, zoom_unpack_s16_##name,			\
+	zoom_pack_s32_##name, zoom_pack_s16_##name			\
+}
+#define PLAN_COPY_SET_N(n) [n] = PLAN_COPY_SET(n),
+
+static const struct zoom_copy_set zoom_copy_sets[] = {
+	PLAN_CHANNELS(PLAN_COPY_SET_N)
+};
+
+static const struct zoom_copy_set zoom_copy_generic = PLAN_COPY_SET(generic);
+
+/* gain and mute in the same pass, S32 saturates */
+static inline s32 zoom_gain(s32 s, u32 gain)
+{
+	return clamp_t(s64, ((s64)s * gain) >> ZOOM_GAIN_SHIFT, S32_MIN,
+		       S32_MAX);
+}
+
+static void zoom_unpack_s32_gain(const struct zoom_plan *plan, void *pcm,
+				 __le32 *urb, unsigned int frames)
+{
+	unsigned int i, c, n = plan->channels;
+	__le32 *dest = pcm;
+
+	for (i = 0; i < frames; i++, dest += n, urb += plan->slots)
+		for (c = 0; c < n; c++)
+			dest[c] = cpu_to_le32(zoom_gain(
+				le32_to_cpu(urb[plan->slot_map[c]]),
+				plan->gain[c]));
+}
+
+static void zoom_unpack_s16_gain(const struct zoom_plan *plan, void *pcm,
+				 __le32 *urb, unsigned int frames)
+{
+	unsigned int i, c, n = plan->channels;
+	__le16 *dest = pcm;
+
+	for (i = 0; i < frames; i++, dest += n, urb += plan->slots)
+		for (c = 0; c < n; c++)
+			dest[c] = cpu_to_le16((u32)zoom_gain(
+				le32_to_cpu(urb[plan->slot_map[c]]),
+				plan->gain[c]) >> 16);
+}
+
+static void zoom_pack_s32_gain(const struct zoom_plan *plan, void *pcm,
+			       __le32 *urb, unsigned int frames)
+{
+	unsigned int i, c, n = plan->channels;
+	const __le32 *src = pcm;
+
+	for (i = 0; i < frames; i++, src += n, urb += plan->slots) {
+		memset(urb, 0, plan->urb_frame_bytes); /* Padding */
+		for (c = 0; c < n; c++)
+			urb[plan->slot_map[c]] = cpu_to_le32(zoom_gain(
+				le32_to_cpu(src[c]), plan->gain[c]));
+	}
+}
+
+static void zoom_pack_s16_gain(const struct zoom_plan *plan, void *pcm,
+			       __le32 *urb, unsigned int frames)
+{
+	unsigned int i, c, n = plan->channels;
+	const __le16 *src = pcm;
+
+	for (i = 0; i < frames; i++, src += n, urb += plan->slots) {
+		memset(urb, 0, plan->urb_frame_bytes); /* Padding */
+		for (c = 0; c < n; c++)
+			urb[plan->slot_map[c]] = cpu_to_le32(zoom_gain(
+				(s32)((u32)le16_to_cpu(src[c]) << 16),
+				plan->gain[c]));
+	}
+}
+
+static const struct zoom_copy_set zoom_copy_gain = PLAN_COPY_SET(gain);
+
+/* S32, unity gain, linear slot maps: SIMD for large urbs */
+static void zoom_unpack_s32_linear(const struct zoom_plan *plan, void *pcm,
+				   __le32 *urb, unsigned int frames)
+{
+	if (!zoom_pack_simd(false, pcm, (u32 *)urb, frames, plan->slots,
+			    plan->slot_map[0], plan->channels))
+		plan->copy_small(plan, pcm, urb, frames);
+}
+
+static void zoom_pack_s32_linear(const struct zoom_plan *plan, void *pcm,
+				 __le32 *urb, unsigned int frames)
+{
+	if (!zoom_pack_simd(true, (u32 *)urb, pcm, frames, plan->slots,
+			    plan->slot_map[0], plan->channels))
+		plan->copy_small(plan, pcm, urb, frames);
+}
+
+/* true if channels 0..channels - 1 sit in consecutive frame slots */
+static bool zoom_slots_linear(const u8 *map, unsigned int channels)
+{
+	unsigned int c;
+
+	for (c = 1; c < channels; c++)
+		if (map[c] != map[0] + c)
+			return false;
+	return true;
+}
+
+/*
+ * Pick the copy routine for a configuration, done once at hw_params time.
+ * gain: Q16 per channel, NULL for unity (the plain copy routines).
+ */
+int zoom_plan_init(struct zoom_plan *plan, bool playback, const u8 *slot_map,
+		   const u32 *gain, unsigned int slots, unsigned int channels,
+		   snd_pcm_format_t format)
+{
+	const struct zoom_copy_set *set = &zoom_copy_generic;
+	bool unity = true;
+	unsigned int c;
+
+	if (!channels || channels > slots || slots > ZOOM_MAX_SLOTS)
+		return -EINVAL;
+
+	if (channels < ARRAY_SIZE(zoom_copy_sets))
+		set = &zoom_copy_sets[channels];
+
+	memset(plan, 0, sizeof(*plan));
+	plan->channels = channels;
+	plan->slots = slots;
+	plan->urb_frame_bytes = slots * 4; /* 32Bit */
+	memcpy(plan->slot_map, slot_map, channels);
+
+	for (c = 0; gain && c < channels; c++) {
+		plan->gain[c] = gain[c];
+		if (gain[c] != ZOOM_GAIN_UNITY)
+			unity = false;
+	}
+	if (!unity)
+		set = &zoom_copy_gain;
+
+	switch (format) {
+	case SNDRV_PCM_FORMAT_S32_LE:
+		plan->frame_bytes = channels * 4;
+		plan->copy = playback ? set->pack_s32 : set->unpack_s32;
+		/* the urb size may change while streaming (profiles), the
+		 * linear copy decides per urb */
+		if (unity && channels >= 4 &&
+		    zoom_slots_linear(slot_map, channels)) {
+			plan->copy_small = plan->copy;
+			plan->copy = playback ? zoom_pack_s32_linear :
+						zoom_unpack_s32_linear;
+		}
+		break;
+	case SNDRV_PCM_FORMAT_S16_LE:
+		plan->frame_bytes = channels * 2;
+		plan->copy = playback ? set->pack_s16 : set->unpack_s16;
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Bit n set if channel n (usb frame slot slot_map[n]) reaches `threshold`
+ * in any of the frames, S32 scale. Stops scanning once all are active.
+ */
+u32 zoom_activity(const __le32 *urb, unsigned int frames, unsigned int slots,
+		  const u8 *slot_map, unsigned int channels, u32 threshold)
+{
+	u32 all = channels < 32 ? BIT(channels) - 1 : ~0U;
+	u32 active = 0;
+	unsigned int i, c;
+	s32 s;
+
+	for (i = 0; i < frames && active != all; i++) {
+		for (c = 0; c < channels; c++) {
+			s = le32_to_cpu(urb[slot_map[c]]);
+			if ((u32)(s ^ (s >> 31)) >= threshold) /* ~|s| */
+				active |= BIT(c);
+		}
+		urb += slots;
+	}
+	return active;
+}
+
+/* channel counts of the supported models and the usual client layouts */
+const unsigned int zoom_pack_test_channels[] = { 1, 2, 4, 12, 14, 22 };
+const unsigned int zoom_pack_n_test_channels =
+	ARRAY_SIZE(zoom_pack_test_channels);
+
+/* best first, NULL after the last */
+const struct zoom_pack_ops *zoom_pack_algo(unsigned int n)
+{
+	return n < ARRAY_SIZE(zoom_pack_algos) ? zoom_pack_algos[n] : NULL;
+}
+
+const struct zoom_pack_ops *zoom_pack_selected(void)
+{
+	return zoom_pack_ops;
+}
+
+static void zoom_pack_run(const struct zoom_pack_ops *ops, bool pack,
+			  u32 *dest, const u32 *src, unsigned int first,
+			  unsigned int channels)
+{
+	bool simd = ops->simd && zoom_simd_begin();
+
+	if (ops->simd && !simd)
+		ops = &zoom_pack_scalar_ops;
+	if (pack)
+		ops->pack(dest, src, ZOOM_PACK_TEST_FRAMES,
+			  ZOOM_PACK_TEST_SLOTS, first, channels);
+	else
+		ops->unpack(dest, src, ZOOM_PACK_TEST_FRAMES,
+			    ZOOM_PACK_TEST_SLOTS, first, channels);
+	if (simd)
+		zoom_simd_end();
+}
+
+/*
+ * Compares `ops` against the scalar reference bit for bit (padding
+ * included) at every slot offset, on the random input in t->frames and
+ * t->pcm.
+ */
+bool zoom_pack_check(const struct zoom_pack_ops *ops,
+		     struct zoom_pack_test *t, unsigned int channels)
+{
+	unsigned int first;
+	size_t len;
+
+	for (first = 0; first + channels <= ZOOM_PACK_TEST_SLOTS; first++) {
+		len = ZOOM_PACK_TEST_FRAMES * channels * 4;
+		memset(t->ref, 0xa5, sizeof(t->ref));
+		memset(t->out, 0x5a, sizeof(t->out));
+		zoom_unpack_scalar(t->ref, t->frames, ZOOM_PACK_TEST_FRAMES,
+				   ZOOM_PACK_TEST_SLOTS, first, channels);
+		zoom_pack_run(ops, false, t->out, t->frames, first, channels);
+		if (memcmp(t->ref, t->out, len))
+			return false;
+
+		len = ZOOM_PACK_TEST_FRAMES * ZOOM_PACK_TEST_SLOTS * 4;
+		memset(t->ref, 0xa5, sizeof(t->ref));
+		memset(t->out, 0x5a, sizeof(t->out));
+		zoom_pack_scalar(t->ref, t->pcm, ZOOM_PACK_TEST_FRAMES,
+				 ZOOM_PACK_TEST_SLOTS, first, channels);
+		zoom_pack_run(ops, true, t->out, t->pcm, first, channels);
+		if (memcmp(t->ref, t->out, len))
+			return false;
+	}
+	return true;
+}
+
+/* selects the best kernel the cpu supports that matches the scalar path */
+int zoom_pack_init(void)
+{
+	const struct zoom_pack_ops *ops;
+	struct zoom_pack_test *t;
+	unsigned int i, c;
+
+	t = kmalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+
+	get_random_bytes(t->frames, sizeof(t->frames));
+	get_random_bytes(t->pcm, sizeof(t->pcm));
+
+	for (i = 0; i < ARRAY_SIZE(zoom_pack_algos); i++) {
+		ops = zoom_pack_algos[i];
+		if (ops->usable && !ops->usable())
+			continue;
+
+		for (c = 0; c < ARRAY_SIZE(zoom_pack_test_channels); c++)
+			if (!zoom_pack_check(ops, t,
+					     zoom_pack_test_channels[c]))
+				break;
+		if (c < ARRAY_SIZE(zoom_pack_test_channels)) {
+			pr_warn("%s pack/unpack mismatch, not used\n",
+				ops->name);
+			continue;
+		}
+
+		zoom_pack_ops = ops;
+		break;
+	}
+
+	pr_info("using %s pack/unpack from %u frame urbs\n",
+		zoom_pack_ops->name, ZOOM_PACK_SIMD_FRAMES);
+	kfree(t);
+	return 0;
+}
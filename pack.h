@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#ifndef ZOOM_PACK_H
+#define ZOOM_PACK_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <sound/pcm.h>
+
+#include "driver.h"
+#else /* built into tools/zoom-replay and zoom-packbench */
+#include "tools/kcompat.h"
+#endif
+
+/* SIMD is only worth the FPU state save for larger URBs (and >= 4 ch) */
+#define ZOOM_PACK_SIMD_FRAMES 32
+
+/* per channel gain, Q16 fixed point, 0 mutes */
+#define ZOOM_GAIN_SHIFT 16
+#define ZOOM_GAIN_UNITY (1U << ZOOM_GAIN_SHIFT)
+#define ZOOM_GAIN_MAX   (4U << ZOOM_GAIN_SHIFT) /* +12 dB */
+
+/*
+ * Frames of `slots` 32 bit slots <-> interleaved frames of `channels`
+ * samples, the live slots are first..first + channels - 1.
+ */
+struct zoom_pack_ops {
+	const char *name;
+	void (*unpack)(u32 *dest, const u32 *src, unsigned int frames,
+		       unsigned int slots, unsigned int first,
+		       unsigned int channels);
+	void (*pack)(u32 *dest, const u32 *src, unsigned int frames,
+		     unsigned int slots, unsigned int first,
+		     unsigned int channels);
+	bool simd; /* uses FPU registers */
+	bool (*usable)(void);
+};
+
+/* buffers of zoom_pack_check(), frames/pcm hold the random input */
+#define ZOOM_PACK_TEST_SLOTS  32
+#define ZOOM_PACK_TEST_FRAMES 64
+
+struct zoom_pack_test {
+	u32 frames[ZOOM_PACK_TEST_FRAMES * ZOOM_PACK_TEST_SLOTS];
+	u32 pcm[ZOOM_PACK_TEST_FRAMES * ZOOM_PACK_TEST_SLOTS];
+	u32 ref[ZOOM_PACK_TEST_FRAMES * ZOOM_PACK_TEST_SLOTS];
+	u32 out[ZOOM_PACK_TEST_FRAMES * ZOOM_PACK_TEST_SLOTS];
+};
+
+struct zoom_plan;
+
+/* copies `frames` frames between the alsa ring and an URB buffer */
+typedef void (*zoom_copy_fn)(const struct zoom_plan *plan, void *pcm,
+			     __le32 *urb, unsigned int frames);
+
+/* copy plan of one hw_params configuration, see zoom_plan_init() */
+struct zoom_plan {
+	zoom_copy_fn copy;
+	zoom_copy_fn copy_small;      /* simd copy: urbs it doesn't pay off */
+	unsigned int channels;
+	unsigned int slots;           /* slots per usb frame */
+	unsigned int frame_bytes;     /* alsa frame */
+	unsigned int urb_frame_bytes; /* usb frame */
+	u8 slot_map[ZOOM_MAX_SLOTS];  /* usb frame slot of each channel */
+	u32 gain[ZOOM_MAX_SLOTS];     /* only used if not all unity */
+};
+
+int zoom_plan_init(struct zoom_plan *plan, bool playback, const u8 *slot_map,
+		   const u32 *gain, unsigned int slots, unsigned int channels,
+		   snd_pcm_format_t format);
+u32 zoom_activity(const __le32 *urb, unsigned int frames, unsigned int slots,
+		  const u8 *slot_map, unsigned int channels, u32 threshold);
+
+extern const unsigned int zoom_pack_test_channels[];
+extern const unsigned int zoom_pack_n_test_channels;
+const struct zoom_pack_ops *zoom_pack_algo(unsigned int n);
+const struct zoom_pack_ops *zoom_pack_selected(void);
+bool zoom_pack_check(const struct zoom_pack_ops *ops,
+		     struct zoom_pack_test *t, unsigned int channels);
+int zoom_pack_init(void);
+#endif /* ZOOM_PACK_H */
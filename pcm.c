@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 /*
- * Linux driver for ZOOM devices (L-8 only at the moment)
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
  *
  * Copyright 2021 (C) Sebastian Reimers
  *
@@ -9,23 +9,158 @@
  */
 
 #include <linux/slab.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/lcm.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/seqlock.h>
+#include <linux/usb/audio.h>
+#include <linux/usb/audio-v2.h>
+#include <linux/usb/hcd.h>
+#include <linux/uaccess.h>
+#include <sound/control.h>
 #include <sound/pcm.h>
+#include <sound/info.h>
+#include <sound/tlv.h>
 
 #include "pcm.h"
 #include "driver.h"
+#include "pack.h"
+#include "decim.h"
+#include "rawdev.h"
+#include "timer.h"
+#include "debug.h"
+#include "uapi.h"
 
-#define IN_EP           0x82
-#define OUT_EP          0x01
-#define PCM_N_URBS      4
-#define PCM_URB_SIZE 512
+#define CREATE_TRACE_POINTS
+#include "trace.h"
+
+#define PCM_N_URBS_MAX  16
 #define PCM_PACKET_SIZE (4 * 4) /* 32 Bit x Frames/URB */
 
+/* default activity threshold, 16 bit scale (about -60 dBFS) */
+#define PCM_ACTIVITY_THRESHOLD 33
+
+static unsigned int urbs_min = 2;
+module_param(urbs_min, uint, 0444);
+MODULE_PARM_DESC(urbs_min, "Min URBs in flight per direction (1-16).");
+static unsigned int urbs_max = 8;
+module_param(urbs_max, uint, 0444);
+MODULE_PARM_DESC(urbs_max, "Max URBs in flight per direction (1-16).");
+
+static bool dropout_fix;
+module_param(dropout_fix, bool, 0644);
+MODULE_PARM_DESC(dropout_fix, "Pad or drop capture frames on dropouts.");
+
+static bool zero_copy;
+module_param(zero_copy, bool, 0444);
+MODULE_PARM_DESC(zero_copy, "Playback in the raw USB frame layout, sent from the ALSA buffer.");
+
+/* completions per dropout detection window */
+#define PCM_TIMELINE_WINDOW 256
+
+/* first completions of both directions after submitting, the device
+ * answers within a few urbs */
+#define PCM_START_TIMEOUT_MS 100
+
+/* windows without margin violations before the queue shrinks */
+#define PCM_DEPTH_QUIET_WINDOWS 10
+
+/* latency profiles, switched at runtime by zoom_pcm_set_profile() */
+struct pcm_profile {
+	unsigned int urbs_min, urbs_max; /* 0: urbs_min/urbs_max parameters */
+	unsigned int urb_frames;         /* rounded up to whole packets */
+	bool adaptive;                   /* depth follows the jitter */
+};
+
+static const struct pcm_profile pcm_profiles[ZOOM_PROFILE_COUNT] = {
+	[ZOOM_PROFILE_ULTRA_LOW] = {
+		.urbs_min = 2, .urbs_max = 2, .urb_frames = 4,
+	},
+	[ZOOM_PROFILE_BALANCED] = {
+		.urb_frames = 4, .adaptive = true,
+	},
+	[ZOOM_PROFILE_ROBUST] = {
+		.urbs_min = 4, .urbs_max = 16, .urb_frames = 32,
+		.adaptive = true,
+	},
+};
+
 struct pcm_urb {
 	struct zoom_chip *chip;
 
 	struct urb instance;
 	struct usb_anchor submitted;
 	u8 *buffer;
+	bool parked; /* not submitted, see struct pcm_depth */
+	unsigned int ring_frames; /* zero copy: frames sent from the ring */
+	unsigned int ring_gen;
+	bool ring_unlink; /* unlinked by zoom_pcm_ring_release(), resubmit */
+};
+
+/*
+ * Adaptive urb queue depth. The in urb handler measures completion
+ * intervals; an interval that eats more than half of the slack of the
+ * queued urbs is a margin violation and grows the queue right away. After
+ * PCM_DEPTH_QUIET_WINDOWS one second windows that would have been fine
+ * with one urb less, it shrinks. Both directions follow `target`: handlers
+ * park their urb when too many are in flight and submit parked ones when
+ * too few are. Profile switches change the bounds and urb size, handlers
+ * apply them to each urb they (re)submit.
+ */
+struct pcm_depth {
+	spinlock_t lock;
+	unsigned int profile;    /* ZOOM_PROFILE_XXX */
+	bool adaptive;
+	unsigned int target;     /* urbs in flight per direction */
+	unsigned int min, max;
+	unsigned int in_flight, out_flight;
+	unsigned int in_len, out_len; /* urb transfer_buffer_length */
+	bool stopped;            /* no (re)submission, set before the kills */
+
+	u64 urb_ns;              /* nominal completion interval */
+	unsigned int window_len; /* completions per window */
+	u64 last_ns;             /* previous in completion, 0 after start */
+	u64 window_max_ns;       /* longest interval in this window */
+	unsigned int window;     /* completions in this window */
+	unsigned int quiet;      /* quiet windows in a row */
+
+	u64 jitter_ns;           /* ewma of |interval - urb_ns| */
+	u64 max_ns;              /* longest interval since start */
+	unsigned long violations, grown, shrunk;
+};
+
+/*
+ * Frames of one direction against CLOCK_MONOTONIC since its first
+ * completion. Late completions only make the frame count look ahead of
+ * time, so the smallest offset of a window is the jitter free one: the
+ * baseline follows it slowly (clock drift), a jump of more than one urb is
+ * a discontinuity, frames the device dropped (missing) or duplicated
+ * (extra). Only touched by the handler of its direction, the in timeline
+ * under rt->in_seq for zoom_pcm_clock_ppb().
+ */
+struct pcm_timeline {
+	u64 start_ns;         /* 0: first completion pending */
+	u64 frames;           /* since start_ns */
+	s64 base_q8;          /* expected - frames, 1/256 frames */
+	s64 win_min_q8;
+	unsigned int win;
+	bool calibrated;      /* the first window sets the baseline */
+	u64 cal_frames;       /* frames at calibration */
+	s64 drift_q8;         /* baseline drift since calibration */
+	unsigned long events;
+	u64 missing, extra;   /* frames */
+};
+
+/* stream endpoint as found in the interface descriptors at probe time */
+struct pcm_endpoint {
+	u8 ifnum;
+	u8 alt;
+	u8 address;          /* bEndpointAddress */
+	u16 maxpacket;       /* wMaxPacketSize */
+	unsigned int urb_size; /* multiple of maxpacket and frame size */
+	unsigned int urb_size_max; /* largest multiple of urb_size */
 };
 
 struct pcm_substream {
@@ -33,8 +168,21 @@ struct pcm_substream {
 	struct snd_pcm_substream *instance;
 
 	bool active;
-	snd_pcm_uframes_t dma_off;    /* current position in alsa dma_area */
+	struct zoom_plan plan;        /* set up in hw_params */
+	snd_pcm_format_t format;      /* of the plan, for chmap changes */
+	u8 order[ZOOM_MAX_SLOTS];     /* model channel of each alsa channel */
+	u32 gain[ZOOM_MAX_SLOTS];     /* Q16 per model channel, see pack.h */
+	u32 mute;                     /* bit n: model channel n muted */
+	snd_pcm_uframes_t dma_off;    /* current frame in alsa dma_area */
 	snd_pcm_uframes_t period_off; /* current position in current period */
+	snd_pcm_uframes_t ring_off;   /* zero copy: next frame to submit */
+	snd_pcm_uframes_t ring_queued; /* zero copy: frames in flight */
+	unsigned int ring_gen;        /* zero copy: urbs of older starts */
+	u32 activity; /* channels above threshold in the current period */
+	int fix; /* frames to pad (> 0) or drop (< 0), dropout_fix */
+	u64 sched_ns;   /* next start at this time, 0: on trigger */
+	bool armed;     /* triggered, waiting for sched_ns */
+	u64 started_ns; /* first frame of the last scheduled start */
 };
 
 enum { /* pcm streaming states */
@@ -47,25 +195,44 @@ enum { /* pcm streaming states */
 struct pcm_runtime {
 	struct zoom_chip *chip;
 	struct snd_pcm *instance;
+	struct snd_pcm *loop_instance; /* device 1, capture only */
+	struct snd_pcm *low_instance;  /* device 2, capture only */
 
 	struct pcm_substream playback;
 	struct pcm_substream capture;
-	bool panic; /* if set driver won't do anymore pcm on device */
-
-	struct pcm_urb out_urbs[PCM_N_URBS];
-	struct pcm_urb in_urbs[PCM_N_URBS];
+	struct pcm_substream loopback; /* out urbs as submitted */
+	struct pcm_substream lowrate;  /* capture decimated by 3 */
+	struct zoom_decim *decim;      /* of lowrate */
+	bool panic; /* stream failed, the next prepare starts it over */
+	bool disconnected; /* no more pcm on the device */
+	unsigned long failures; /* streams that ended in panic */
+	int fail_status;        /* urb status or submit error of the last */
+	bool zero_copy;         /* out urbs dma from the playback buffer */
+	atomic_t ring_urbs;     /* out urbs in flight from that buffer */
+	bool urbs_poisoned;     /* by zoom_pcm_stream_stop() */
+
+	struct pcm_endpoint out_ep;
+	struct pcm_endpoint in_ep;
+	struct pcm_urb out_urbs[PCM_N_URBS_MAX];
+	struct pcm_urb in_urbs[PCM_N_URBS_MAX];
+	struct pcm_depth depth;
+	struct pcm_timeline out_tl, in_tl;
+	seqcount_t in_seq;      /* in_tl writes */
+	u32 activity_threshold; /* S32 scale */
+	u32 activity;           /* of the last capture period */
+
+	struct snd_pcm_hw_constraint_list rate_list; /* from chip->model */
 
 	struct mutex stream_mutex;
-	u8 stream_state; /* one of STREAM_XXX */
-	wait_queue_head_t stream_wait_queue;
-	bool stream_wait_cond;
-};
-
-static const unsigned int rates[] = { 48000 };
-static const struct snd_pcm_hw_constraint_list constraints_extra_rates = {
-	.count = ARRAY_SIZE(rates),
-	.list = rates,
-	.mask = 0,
+	unsigned int raw_users; /* open /dev/zoomN files */
+	u8 stream_state; /* one of STREAM_XXX, see zoom_pcm_set_state() */
+
+	/* cold start: first completion of each direction after submit,
+	 * re-armed by every zoom_pcm_stream_start() */
+	struct completion out_started, in_started;
+	u64 submit_ns;
+	u64 out_start_ns, in_start_ns; /* delay of the last start */
+	u64 start_max_ns;
 };
 
 static const struct snd_pcm_hardware pcm_hw = {
@@ -76,13 +243,13 @@ static const struct snd_pcm_hardware pcm_hw = {
 		SNDRV_PCM_INFO_MMAP_VALID |
 		SNDRV_PCM_INFO_BATCH,
 
-	.formats = SNDRV_PCM_FMTBIT_S32_LE,
+	.formats = SNDRV_PCM_FMTBIT_S32_LE | SNDRV_PCM_FMTBIT_S16_LE,
 
 	.rates = SNDRV_PCM_RATE_48000,
 	.rate_min = 48000,
 	.rate_max = 48000,
 	.channels_min = 2,
-	.channels_max = 4,
+	.channels_max = 4, /* model->out_channels */
 	.buffer_bytes_max = 1024 * 1024,
 	.period_bytes_min = PCM_PACKET_SIZE * 2,
 	.period_bytes_max = 512 * 1024,
@@ -98,13 +265,13 @@ static const struct snd_pcm_hardware pcm_hw_rec = {
 		SNDRV_PCM_INFO_MMAP_VALID |
 		SNDRV_PCM_INFO_BATCH,
 
-	.formats = SNDRV_PCM_FMTBIT_S32_LE,
+	.formats = SNDRV_PCM_FMTBIT_S32_LE | SNDRV_PCM_FMTBIT_S16_LE,
 
 	.rates = SNDRV_PCM_RATE_48000,
 	.rate_min = 48000,
 	.rate_max = 48000,
 	.channels_min = 1,
-	.channels_max = 12,
+	.channels_max = 12, /* model->in_channels */
 	.buffer_bytes_max = 1024 * 1024,
 	.period_bytes_min = PCM_PACKET_SIZE * 12,
 	.period_bytes_max = 512 * 1024,
@@ -118,6 +285,12 @@ static struct pcm_substream *zoom_pcm_get_substream(struct snd_pcm_substream
 	struct pcm_runtime *rt = snd_pcm_substream_chip(alsa_sub);
 	struct device *device = &rt->chip->dev->dev;
 
+	if (alsa_sub->pcm == rt->loop_instance)
+		return &rt->loopback;
+
+	if (alsa_sub->pcm == rt->low_instance)
+		return &rt->lowrate;
+
 	if (alsa_sub->stream == SNDRV_PCM_STREAM_PLAYBACK)
 		return &rt->playback;
 
@@ -128,41 +301,94 @@ static struct pcm_substream *zoom_pcm_get_substream(struct snd_pcm_substream
 	return NULL;
 }
 
+/*
+ * DISABLED -> STARTING: urbs submitted, waiting for the first completions
+ * STARTING -> RUNNING: both directions completed an urb
+ * STARTING, RUNNING -> STOPPING -> DISABLED: urbs killed
+ *
+ * Call with stream_mutex locked, the urb handlers only read the state.
+ */
+static void zoom_pcm_set_state(struct pcm_runtime *rt, u8 state)
+{
+	trace_zoom_stream_state(rt->chip->card->number, rt->stream_state,
+				state);
+	WRITE_ONCE(rt->stream_state, state);
+}
+
+/* from the urb handlers, completes the cold start of one direction */
+static void zoom_pcm_started(struct pcm_runtime *rt, bool in, u64 now)
+{
+	struct completion *done = in ? &rt->in_started : &rt->out_started;
+	u64 *delay = in ? &rt->in_start_ns : &rt->out_start_ns;
+
+	if (READ_ONCE(rt->stream_state) != STREAM_STARTING ||
+	    completion_done(done))
+		return;
+
+	*delay = now - rt->submit_ns;
+	trace_zoom_stream_first_urb(rt->chip->card->number, in, *delay);
+	complete_all(done);
+}
+
 /* call with stream_mutex locked */
 static void zoom_pcm_stream_stop(struct pcm_runtime *rt)
 {
 	int i, time;
 
 	if (rt->stream_state != STREAM_DISABLED) {
-		rt->stream_state = STREAM_STOPPING;
+		zoom_pcm_set_state(rt, STREAM_STOPPING);
 
-		for (i = 0; i < PCM_N_URBS; i++) {
+		/* a handler past its state check may still unpark another
+		 * urb: no more unparking, and poisoned urbs refuse a submit
+		 * that comes after their kill */
+		spin_lock_irq(&rt->depth.lock);
+		rt->depth.stopped = true;
+		spin_unlock_irq(&rt->depth.lock);
+
+		for (i = 0; i < PCM_N_URBS_MAX; i++) {
 			time = usb_wait_anchor_empty_timeout(
 					&rt->out_urbs[i].submitted, 100);
 			if (!time)
 				usb_kill_anchored_urbs(
 					&rt->out_urbs[i].submitted);
-			usb_kill_urb(&rt->out_urbs[i].instance);
+			usb_poison_urb(&rt->out_urbs[i].instance);
 		}
 
-		for (i = 0; i < PCM_N_URBS; i++) {
+		for (i = 0; i < PCM_N_URBS_MAX; i++) {
 			time = usb_wait_anchor_empty_timeout(
 					&rt->in_urbs[i].submitted, 100);
 			if (!time)
 				usb_kill_anchored_urbs(
 					&rt->in_urbs[i].submitted);
-			usb_kill_urb(&rt->in_urbs[i].instance);
+			usb_poison_urb(&rt->in_urbs[i].instance);
 		}
 
-		rt->stream_state = STREAM_DISABLED;
+		rt->urbs_poisoned = true;
+		zoom_pcm_set_state(rt, STREAM_DISABLED);
 	}
 }
 
+/* call with stream_mutex locked */
+static bool zoom_pcm_stream_idle(struct pcm_runtime *rt)
+{
+	return !rt->playback.instance && !rt->capture.instance &&
+	       !rt->loopback.instance && !rt->lowrate.instance &&
+	       !rt->raw_users;
+}
+
+/* the out urb sends its own buffer (silence or copied frames) */
+static void zoom_pcm_urb_own(struct pcm_urb *urb)
+{
+	urb->instance.transfer_buffer = urb->buffer;
+	urb->instance.transfer_flags &= ~URB_NO_TRANSFER_DMA_MAP;
+}
+
 static int zoom_interface_init(struct pcm_runtime *rt)
 {
 	int ret = 0;
 
-	ret = usb_set_interface(rt->chip->dev, 1, 3); /* ALT=1 EP1 OUT 32 bit */
+	/* OUT 32 bit */
+	ret = usb_set_interface(rt->chip->dev, rt->out_ep.ifnum, rt->out_ep.alt);
 	if (ret != 0) {
 		zoom_pcm_stream_stop(rt);
 		dev_err(&rt->chip->dev->dev,
@@ -170,7 +396,8 @@ static int zoom_interface_init(struct pcm_runtime *rt)
 		return -EIO;
 	}
 
-	ret = usb_set_interface(rt->chip->dev, 2, 3); /* ALT=2 EP2 IN 32 bit */
+	/* IN 32 bit */
+	ret = usb_set_interface(rt->chip->dev, rt->in_ep.ifnum, rt->in_ep.alt);
 	if (ret != 0) {
 		zoom_pcm_stream_stop(rt);
 		dev_err(&rt->chip->dev->dev,
@@ -184,6 +411,8 @@ static int zoom_interface_init(struct pcm_runtime *rt)
 /* call with stream_mutex locked */
 static int zoom_pcm_stream_start(struct pcm_runtime *rt)
 {
+	unsigned long timeout = msecs_to_jiffies(PCM_START_TIMEOUT_MS);
+	unsigned int n;
 	int ret = 0;
 	int i;
 
@@ -191,17 +420,53 @@ static int zoom_pcm_stream_start(struct pcm_runtime *rt)
 
 		/* reset panic state when starting a new stream */
 		rt->panic = false;
-		
+
 		/* the device is rather forgetful, after some time without
 		 * URBs the device fallbacks to 16bit mode */
 		ret = zoom_interface_init(rt);
 		if (ret)
 			return ret;
 
-		/* submit our out urbs zero init */
-		rt->stream_state = STREAM_STARTING;
-		for (i = 0; i < PCM_N_URBS; i++) {
-			memset(rt->out_urbs[i].buffer, 0, PCM_URB_SIZE);
+		/* submit our out urbs zero init, the first `target` of each
+		 * direction, the rest stays parked */
+		memset(&rt->out_tl, 0, sizeof(rt->out_tl));
+		reinit_completion(&rt->out_started);
+		reinit_completion(&rt->in_started);
+		rt->submit_ns = ktime_get_ns();
+		zoom_pcm_set_state(rt, STREAM_STARTING);
+		spin_lock_irq(&rt->depth.lock);
+		write_seqcount_begin(&rt->in_seq);
+		memset(&rt->in_tl, 0, sizeof(rt->in_tl));
+		write_seqcount_end(&rt->in_seq);
+		n = rt->depth.target;
+		rt->depth.stopped = false;
+		rt->depth.in_flight = n;
+		rt->depth.out_flight = n;
+		rt->depth.last_ns = 0;
+		rt->depth.window = 0;
+		rt->depth.window_max_ns = 0;
+		rt->depth.quiet = 0;
+		for (i = 0; i < PCM_N_URBS_MAX; i++) {
+			zoom_pcm_urb_own(&rt->out_urbs[i]);
+			rt->out_urbs[i].ring_unlink = false;
+			rt->out_urbs[i].parked = i >= n;
+			rt->out_urbs[i].instance.transfer_buffer_length =
+				rt->depth.out_len;
+			rt->in_urbs[i].parked = i >= n;
+			rt->in_urbs[i].instance.transfer_buffer_length =
+				rt->depth.in_len;
+		}
+		spin_unlock_irq(&rt->depth.lock);
+
+		for (i = 0; rt->urbs_poisoned && i < PCM_N_URBS_MAX; i++) {
+			usb_unpoison_urb(&rt->out_urbs[i].instance);
+			usb_unpoison_urb(&rt->in_urbs[i].instance);
+		}
+		rt->urbs_poisoned = false;
+
+		for (i = 0; i < n; i++) {
+			memset(rt->out_urbs[i].buffer, 0,
+			       rt->out_ep.urb_size_max);
 			usb_anchor_urb(&rt->out_urbs[i].instance,
 				       &rt->out_urbs[i].submitted);
 			ret = usb_submit_urb(&rt->out_urbs[i].instance,
@@ -221,236 +486,739 @@ static int zoom_pcm_stream_start(struct pcm_runtime *rt)
 			}
 		}
 
-		/* wait for first out urb to return (sent in in urb handler) */
-		wait_event_timeout(rt->stream_wait_queue, rt->stream_wait_cond,
-				   HZ);
-		if (rt->stream_wait_cond) {
-			struct device *device = &rt->chip->dev->dev;
-			dev_info(device, "%s: Stream is running wakeup event\n",
-				 __func__);
-			rt->stream_state = STREAM_RUNNING;
-		} else {
+		/* the device streams once both directions completed an urb */
+		timeout = wait_for_completion_timeout(&rt->out_started,
+						      timeout);
+		if (timeout)
+			timeout = wait_for_completion_timeout(&rt->in_started,
+							      timeout);
+		if (!timeout) {
+			dev_err(&rt->chip->dev->dev,
+				"stream start timed out (out %s, in %s)\n",
+				completion_done(&rt->out_started) ? "ok" : "-",
+				completion_done(&rt->in_started) ? "ok" : "-");
 			zoom_pcm_stream_stop(rt);
 			return -EIO;
 		}
+
+		rt->start_max_ns = max3(rt->start_max_ns, rt->out_start_ns,
+					rt->in_start_ns);
+		zoom_pcm_set_state(rt, STREAM_RUNNING);
 	}
 	return ret;
 }
 
-
-static void memcpy_pcm(u8 *dest, u8 *src, u8 ch_sz,
-		unsigned int skip, unsigned int len, bool padding)
+/*
+ * Call with stream_mutex locked, starts the stream if it isn't running. A
+ * failed one is stopped and started over: the substreams it carried got an
+ * xrun and rejoin through their own prepare.
+ */
+static int zoom_pcm_stream_get(struct pcm_runtime *rt)
 {
-	unsigned int i, c, o = 0;
+	if (rt->disconnected)
+		return -ENODEV;
+	if (rt->panic)
+		zoom_pcm_stream_stop(rt);
+	if (rt->stream_state == STREAM_DISABLED)
+		return zoom_pcm_stream_start(rt);
+	return 0;
+}
 
-	for (i = 0; i < PCM_URB_SIZE; i++) {
-		if (i % 128) {
-			if (padding)
-				dest[i] = 0; /* Padding */
-			continue;
-		}
 
-		for (c = 0; c < ch_sz; c++) {
-			if (skip && skip--) {
-				i++;
-				continue;
-			}
+/* call with substream locked */
+/* returns true if a period elapsed */
+static bool zoom_pcm_period_advance(struct pcm_substream *sub,
+				    unsigned int frames)
+{
+	struct snd_pcm_runtime *alsa_rt = sub->instance->runtime;
 
-			if (len && o >= len)
-				return;
+	sub->dma_off += frames;
+	if (sub->dma_off >= alsa_rt->buffer_size)
+		sub->dma_off -= alsa_rt->buffer_size;
 
-			if (padding)
-				dest[i++] = src[o++];
-			else
-				dest[o++] = src[i++];
-		}
+	sub->period_off += frames;
+	if (sub->period_off >= alsa_rt->period_size) {
+		sub->period_off %= alsa_rt->period_size;
+		return true;
 	}
+	return false;
 }
 
 /* call with substream locked */
-/* returns true if a period elapsed */
-static bool zoom_pcm_capture(struct pcm_substream *sub, struct pcm_urb *urb)
+static void zoom_pcm_silence(struct pcm_substream *sub, unsigned int frames)
 {
 	struct snd_pcm_runtime *alsa_rt = sub->instance->runtime;
-	struct device *device = &urb->chip->dev->dev;
-	u8 *dest;
-	u8 ch_sz = alsa_rt->channels * 4; /* 32Bit */
-	unsigned int pcm_buffer_size, pcm_len, len;
+	unsigned int frame_bytes = sub->plan.frame_bytes;
+	unsigned int len;
 
-	WARN_ON(alsa_rt->format != SNDRV_PCM_FORMAT_S32_LE);
+	len = min_t(snd_pcm_uframes_t, frames, alsa_rt->buffer_size - sub->dma_off);
+	memset(alsa_rt->dma_area + sub->dma_off * frame_bytes, 0,
+	       len * frame_bytes);
+	memset(alsa_rt->dma_area, 0, (frames - len) * frame_bytes);
+}
 
-	pcm_buffer_size = snd_pcm_lib_buffer_bytes(sub->instance);
+/* call with substream locked */
+/* returns true if a period elapsed */
+static bool zoom_pcm_capture(struct pcm_substream *sub, struct pcm_urb *urb,
+			     unsigned int bytes)
+{
+	const struct zoom_plan *plan = &sub->plan;
+	struct snd_pcm_runtime *alsa_rt = sub->instance->runtime;
+	__le32 *src = urb->instance.transfer_buffer; /* loopback: maybe ring */
+	unsigned int frames = bytes / plan->urb_frame_bytes;
+	bool elapsed = false;
+	unsigned int len;
+
+	/* dropout_fix: silence for missing frames, skip extra ones; at most a
+	 * period per urb, the rest is padded with the next ones */
+	if (unlikely(sub->fix > 0)) {
+		len = min_t(snd_pcm_uframes_t, sub->fix, alsa_rt->period_size);
+		zoom_pcm_silence(sub, len);
+		elapsed = zoom_pcm_period_advance(sub, len);
+		sub->fix -= len;
+	} else if (unlikely(sub->fix < 0)) {
+		len = min_t(unsigned int, -sub->fix, frames);
+		sub->fix += len;
+		src += len * plan->slots;
+		frames -= len;
+	}
 
-	pcm_len = ch_sz * 4; /* Channel size * 4 Frames */
+	/* frames up to the end of the ring buffer, then the rest */
+	len = min_t(snd_pcm_uframes_t, frames, alsa_rt->buffer_size - sub->dma_off);
+	plan->copy(plan, alsa_rt->dma_area + sub->dma_off * plan->frame_bytes,
+		   src, len);
+	plan->copy(plan, alsa_rt->dma_area, src + len * plan->slots,
+		   frames - len);
 
-	if (sub->dma_off + pcm_len <= pcm_buffer_size) {
-		dev_dbg(device, "%s: (1) buffer_size %#x dma_offset %#x\n", __func__,
-			 (unsigned int) pcm_buffer_size,
-			 (unsigned int) sub->dma_off);
+	return zoom_pcm_period_advance(sub, frames) || elapsed;
+}
 
-		dest = alsa_rt->dma_area + sub->dma_off;
-		memcpy_pcm(dest, urb->buffer, ch_sz, 0, 0, false);
-	} else {
-		/* wrap around at end of ring buffer */
-		dev_dbg(device, "%s: (2) buffer_size %#x dma_offset %#x\n", __func__,
-			 (unsigned int) pcm_buffer_size,
-			 (unsigned int) sub->dma_off);
-		
-		len = pcm_buffer_size - sub->dma_off;
-		dest = alsa_rt->dma_area + sub->dma_off;
-		memcpy_pcm(dest, urb->buffer, ch_sz, 0, len, false);
+/*
+ * Call with substream locked. Activates an armed substream with the urb
+ * that completes (or is expected to) at `done_ns`, once that is at or after
+ * its scheduled start; the start time of its first frame is reported.
+ */
+static void zoom_pcm_sched_check(struct pcm_runtime *rt,
+				 struct pcm_substream *sub, u64 done_ns,
+				 unsigned int frames)
+{
+	if (likely(!sub->armed) || done_ns < sub->sched_ns)
+		return;
 
-		dest = alsa_rt->dma_area;
-		memcpy_pcm(dest, urb->buffer, ch_sz, len, pcm_len - len, false);
+	sub->armed = false;
+	sub->active = true;
+	sub->sched_ns = 0;
+	sub->started_ns = done_ns - div_u64((u64)frames * NSEC_PER_SEC,
+					    rt->chip->model->rates[0]);
+}
 
-	}
-	sub->dma_off += pcm_len;
-	if (sub->dma_off >= pcm_buffer_size)
-		sub->dma_off -= pcm_buffer_size;
+/* call with substream locked */
+/* returns true if a period elapsed */
+static bool zoom_pcm_decimate(struct pcm_runtime *rt, struct pcm_substream *sub,
+			      struct pcm_urb *urb, unsigned int bytes)
+{
+	const struct zoom_plan *plan = &sub->plan;
+	struct snd_pcm_runtime *alsa_rt = sub->instance->runtime;
+	const __le32 *src = (__le32 *)urb->buffer;
+	unsigned int frames = bytes / plan->urb_frame_bytes;
+	bool elapsed = false;
+	unsigned int i;
 
-	sub->period_off += pcm_len;
-	if (sub->period_off >= alsa_rt->period_size) {
-		sub->period_off %= alsa_rt->period_size;
-		return true;
+	for (i = 0; i < frames; i++, src += plan->slots) {
+		if (!zoom_decim_push(rt->decim, src, plan->slot_map))
+			continue;
+		zoom_decim_out(rt->decim, alsa_rt->dma_area +
+			       sub->dma_off * plan->frame_bytes, sub->format);
+		elapsed |= zoom_pcm_period_advance(sub, 1);
 	}
-	return false;
+	return elapsed;
 }
 
 /* call with substream locked */
 /* returns true if a period elapsed */
 static bool zoom_pcm_playback(struct pcm_substream *sub, struct pcm_urb *urb)
 {
+	const struct zoom_plan *plan = &sub->plan;
 	struct snd_pcm_runtime *alsa_rt = sub->instance->runtime;
-	struct device *device = &urb->chip->dev->dev;
-	u8 *source;
-	u8 ch_sz = alsa_rt->channels * 4; /* 32Bit */
-	unsigned int pcm_buffer_size, pcm_len, len;
+	__le32 *dest = (__le32 *)urb->buffer;
+	unsigned int frames = urb->instance.transfer_buffer_length /
+			      plan->urb_frame_bytes;
+	unsigned int len;
+
+	/* frames up to the end of the ring buffer, then the rest */
+	len = min_t(snd_pcm_uframes_t, frames, alsa_rt->buffer_size - sub->dma_off);
+	plan->copy(plan, alsa_rt->dma_area + sub->dma_off * plan->frame_bytes,
+		   dest, len);
+	plan->copy(plan, alsa_rt->dma_area, dest + len * plan->slots,
+		   frames - len);
+
+	return zoom_pcm_period_advance(sub, frames);
+}
 
-	WARN_ON(alsa_rt->format != SNDRV_PCM_FORMAT_S32_LE);
+/*
+ * Call with substream locked, zero copy: the urb sends the next frames
+ * straight from the playback buffer, which has the usb frame layout. Only
+ * the pointers move, the frames count as played on completion. The buffer
+ * size is a multiple of the urb size, an urb ends at the buffer end.
+ * False if the application hasn't written these frames yet.
+ */
+static bool zoom_pcm_playback_ring(struct pcm_runtime *rt,
+				   struct pcm_substream *sub,
+				   struct pcm_urb *urb)
+{
+	struct snd_pcm_runtime *alsa_rt = sub->instance->runtime;
+	snd_pcm_uframes_t size = alsa_rt->buffer_size;
+	unsigned int frame_bytes = zoom_frame_bytes(rt->chip->model);
+	unsigned int frames = urb->instance.transfer_buffer_length /
+			      frame_bytes;
+	size_t off = sub->ring_off * frame_bytes;
+	snd_pcm_sframes_t ahead;
+
+	frames = min_t(snd_pcm_uframes_t, frames, size - sub->ring_off);
+
+	/* written beyond hw_ptr, less the frames dma_off holds back until
+	 * the next period and those already in flight */
+	ahead = snd_pcm_playback_hw_avail(alsa_rt);
+	ahead -= (sub->dma_off + size - alsa_rt->status->hw_ptr % size) % size;
+	ahead -= sub->ring_queued;
+	if (ahead < (snd_pcm_sframes_t)frames)
+		return false;
+
+	urb->instance.transfer_buffer = alsa_rt->dma_area + off;
+	urb->instance.transfer_dma = alsa_rt->dma_addr + off;
+	urb->instance.transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+	urb->instance.transfer_buffer_length = frames * frame_bytes;
+	urb->ring_frames = frames;
+	urb->ring_gen = sub->ring_gen;
+	atomic_inc(&rt->ring_urbs);
+
+	sub->ring_off += frames;
+	if (sub->ring_off >= size)
+		sub->ring_off = 0;
+	sub->ring_queued += frames;
+	return true;
+}
 
-	pcm_buffer_size = snd_pcm_lib_buffer_bytes(sub->instance);
+/* zero copy: the urb is done with the playback buffer, whatever it sent */
+static void zoom_pcm_ring_put(struct pcm_runtime *rt, struct pcm_urb *urb)
+{
+	struct pcm_substream *sub = &rt->playback;
+	unsigned long flags;
 
-	pcm_len = ch_sz * 4; /* Channel size * 4 Frames */
+	spin_lock_irqsave(&sub->lock, flags);
+	if (urb->ring_gen == sub->ring_gen)
+		sub->ring_queued -= min_t(snd_pcm_uframes_t, sub->ring_queued,
+					  urb->ring_frames);
+	spin_unlock_irqrestore(&sub->lock, flags);
+	urb->ring_frames = 0;
+	atomic_dec(&rt->ring_urbs);
+}
 
-	if (sub->dma_off + pcm_len <= pcm_buffer_size) {
-		dev_dbg(device, "%s: (1) buffer_size %#x dma_offset %#x\n", __func__,
-			 (unsigned int) pcm_buffer_size,
-			 (unsigned int) sub->dma_off);
+/* zero copy: `frames` of the playback buffer were sent, true if a period
+ * elapsed */
+static bool zoom_pcm_ring_done(struct pcm_runtime *rt, struct pcm_urb *urb,
+			       unsigned int frames)
+{
+	struct pcm_substream *sub = &rt->playback;
+	bool elapsed = false;
+	unsigned long flags;
 
-		source = alsa_rt->dma_area + sub->dma_off;
-		memcpy_pcm(urb->buffer, source, ch_sz, 0, 0, true);
-	} else {
-		/* wrap around at end of ring buffer */
-		dev_info(device, "%s: (2) buffer_size %#x dma_offset %#x\n", __func__,
-			 (unsigned int) pcm_buffer_size,
-			 (unsigned int) sub->dma_off);
+	spin_lock_irqsave(&sub->lock, flags);
+	if (sub->active && urb->ring_gen == sub->ring_gen)
+		elapsed = zoom_pcm_period_advance(sub, frames);
+	spin_unlock_irqrestore(&sub->lock, flags);
+	return elapsed;
+}
 
-		len = pcm_buffer_size - sub->dma_off;
-		source = alsa_rt->dma_area + sub->dma_off;
-		memcpy_pcm(urb->buffer, source, ch_sz, 0, len, true);
+/* from the urb handlers: stops streaming and reports an xrun to the clients */
+static void zoom_pcm_fail(struct pcm_runtime *rt, int status)
+{
+	struct pcm_substream *subs[] = {
+		&rt->playback, &rt->capture, &rt->loopback, &rt->lowrate
+	};
+	struct snd_pcm_substream *alsa_sub;
+	unsigned long flags;
+	int i;
 
-		source = alsa_rt->dma_area;
-		memcpy_pcm(urb->buffer, source, ch_sz, len, pcm_len - len, true);
+	/* urbs of a stopping stream refuse the resubmit on purpose */
+	if (READ_ONCE(rt->stream_state) == STREAM_STOPPING)
+		return;
+	if (xchg(&rt->panic, true))
+		return;
+	rt->failures++;
+	rt->fail_status = status;
+	if (status != -ENODEV && status != -ESHUTDOWN) /* unplugged */
+		dev_warn_ratelimited(&rt->chip->dev->dev,
+				     "urb failed (%d), stream stopped\n",
+				     status);
+
+	for (i = 0; i < ARRAY_SIZE(subs); i++) {
+		spin_lock_irqsave(&subs[i]->lock, flags);
+		alsa_sub = subs[i]->active || subs[i]->armed ?
+			   subs[i]->instance : NULL;
+		spin_unlock_irqrestore(&subs[i]->lock, flags);
+		if (alsa_sub)
+			snd_pcm_stop_xrun(alsa_sub);
 	}
-	sub->dma_off += pcm_len;
-	if (sub->dma_off >= pcm_buffer_size)
-		sub->dma_off -= pcm_buffer_size;
+}
 
-	sub->period_off += pcm_len;
-	if (sub->period_off >= alsa_rt->period_size) {
-		sub->period_off %= alsa_rt->period_size;
-		return true;
+/*
+ * The buffer is freed after hw_free, no urb may still send from it. The
+ * stream may carry other PCMs: stuck ring urbs are unlinked and their
+ * handler resubmits them with silence; only if that doesn't return them
+ * either the stream is stopped (xrun, restarted by the next prepare).
+ */
+static void zoom_pcm_ring_release(struct pcm_runtime *rt)
+{
+	struct pcm_urb *urb;
+	int i;
+
+	for (i = 0; i < 100 && atomic_read(&rt->ring_urbs); i++)
+		usleep_range(1000, 2000);
+	if (!atomic_read(&rt->ring_urbs))
+		return;
+
+	dev_warn(&rt->chip->dev->dev, "out urbs stuck, unlinking them\n");
+	mutex_lock(&rt->stream_mutex);
+	for (i = 0; i < PCM_N_URBS_MAX; i++) {
+		urb = &rt->out_urbs[i];
+		if (!READ_ONCE(urb->ring_frames))
+			continue;
+		WRITE_ONCE(urb->ring_unlink, true);
+		usb_unlink_urb(&urb->instance);
 	}
-	return false;
+	for (i = 0; i < 100 && atomic_read(&rt->ring_urbs); i++)
+		usleep_range(1000, 2000);
+	if (atomic_read(&rt->ring_urbs)) {
+		zoom_pcm_fail(rt, -ETIMEDOUT);
+		zoom_pcm_stream_stop(rt);
+	}
+	mutex_unlock(&rt->stream_mutex);
+}
+
+/*
+ * From the urb handler of the direction, `frames` frames completed at
+ * `now`. Returns the frames missing (> 0) or extra (< 0) at the end of a
+ * window that found a discontinuity.
+ */
+static int zoom_pcm_timeline(struct pcm_runtime *rt, struct pcm_timeline *tl,
+			     bool in, unsigned int frames, u64 now)
+{
+	unsigned int rate = rt->chip->model->rates[0];
+	s64 tol_q8 = (s64)max(READ_ONCE(rt->depth.in_len) /
+			      zoom_frame_bytes(rt->chip->model), 4U) << 8;
+	s64 off_q8, step;
+
+	if (!tl->start_ns) {
+		tl->start_ns = now; /* the frames of this urb are before */
+		tl->win_min_q8 = S64_MAX;
+		return 0;
+	}
+
+	tl->frames += frames;
+	off_q8 = (s64)mul_u64_u32_div(now - tl->start_ns, rate << 8,
+				      NSEC_PER_SEC) -
+		 (s64)(tl->frames << 8) - tl->base_q8;
+	tl->win_min_q8 = min(tl->win_min_q8, off_q8);
+
+	if (++tl->win < PCM_TIMELINE_WINDOW)
+		return 0;
+
+	off_q8 = tl->win_min_q8;
+	tl->win_min_q8 = S64_MAX;
+	tl->win = 0;
+
+	/* the first completion may have been late itself */
+	if (!tl->calibrated) {
+		tl->base_q8 += off_q8;
+		tl->calibrated = true;
+		tl->cal_frames = tl->frames;
+		return 0;
+	}
+
+	if (off_q8 <= tol_q8 && off_q8 >= -tol_q8) {
+		tl->base_q8 += off_q8 >> 3; /* drift */
+		tl->drift_q8 += off_q8 >> 3;
+		return 0;
+	}
+
+	tl->base_q8 += off_q8;
+	step = off_q8 >> 8;
+	tl->events++;
+	if (step > 0)
+		tl->missing += step;
+	else
+		tl->extra += -step;
+	trace_zoom_stream_discontinuity(rt->chip->card->number, in, step);
+	return step;
+}
+
+/* publishes the activity of a finished capture period */
+static void zoom_pcm_activity_update(struct pcm_runtime *rt, u32 active)
+{
+	struct snd_kcontrol *kctl = rt->chip->activity_ctl;
+
+	if (READ_ONCE(rt->activity) == active)
+		return;
+	WRITE_ONCE(rt->activity, active);
+	if (kctl)
+		snd_ctl_notify(rt->chip->card, SNDRV_CTL_EVENT_MASK_VALUE,
+			       &kctl->id);
+}
+
+/* call with depth.lock held, from the in urb handler */
+static void zoom_pcm_depth_update(struct pcm_depth *d, u64 now)
+{
+	u64 interval, dev;
+
+	if (!d->last_ns) {
+		d->last_ns = now;
+		return;
+	}
+	interval = now - d->last_ns;
+	d->last_ns = now;
+
+	dev = interval > d->urb_ns ? interval - d->urb_ns :
+				     d->urb_ns - interval;
+	d->jitter_ns = d->jitter_ns - (d->jitter_ns >> 4) + (dev >> 4);
+	d->max_ns = max(d->max_ns, interval);
+	d->window_max_ns = max(d->window_max_ns, interval);
+
+	if (!d->adaptive)
+		return;
+
+	/* late by more than half the slack of the other queued urbs */
+	if (interval > d->urb_ns + (d->target - 1) * d->urb_ns / 2) {
+		d->violations++;
+		d->quiet = 0;
+		if (d->target < d->max) {
+			d->target++;
+			d->grown++;
+		}
+	}
+
+	if (++d->window < d->window_len)
+		return;
+
+	/* would one urb less still have kept half of its slack? */
+	if (d->target > d->min &&
+	    d->window_max_ns <= d->urb_ns + (d->target - 2) * d->urb_ns / 2)
+		d->quiet++;
+	else
+		d->quiet = 0;
+
+	if (d->quiet >= PCM_DEPTH_QUIET_WINDOWS) {
+		d->target--;
+		d->shrunk++;
+		d->quiet = 0;
+	}
+	d->window = 0;
+	d->window_max_ns = 0;
+}
+
+/*
+ * Returns false if the completed urb was parked to shrink the queue,
+ * otherwise sets the urb size of the current profile for its resubmission.
+ */
+static bool zoom_pcm_depth_keep(struct pcm_runtime *rt, struct pcm_urb *urb,
+				bool in)
+{
+	struct pcm_depth *d = &rt->depth;
+	unsigned int *flight = in ? &d->in_flight : &d->out_flight;
+	unsigned long flags;
+	bool keep = true;
+
+	spin_lock_irqsave(&d->lock, flags);
+	if (d->stopped || *flight > d->target) {
+		urb->parked = true;
+		(*flight)--;
+		keep = false;
+	} else {
+		urb->instance.transfer_buffer_length = in ? d->in_len :
+							    d->out_len;
+	}
+	spin_unlock_irqrestore(&d->lock, flags);
+	return keep;
+}
+
+/*
+ * The completion of `urb` was dropped (fault_drop): it waits parked, so
+ * the next handler submits a parked urb in its place.
+ */
+static void zoom_pcm_depth_drop(struct pcm_runtime *rt, struct pcm_urb *urb,
+				bool in)
+{
+	struct pcm_depth *d = &rt->depth;
+	unsigned int *flight = in ? &d->in_flight : &d->out_flight;
+	unsigned long flags;
+
+	spin_lock_irqsave(&d->lock, flags);
+	urb->parked = true;
+	(*flight)--;
+	spin_unlock_irqrestore(&d->lock, flags);
+}
+
+/* returns a parked urb to submit if the queue is below its target */
+static struct pcm_urb *zoom_pcm_depth_unpark(struct pcm_runtime *rt, bool in)
+{
+	struct pcm_depth *d = &rt->depth;
+	struct pcm_urb *urbs = in ? rt->in_urbs : rt->out_urbs;
+	unsigned int *flight = in ? &d->in_flight : &d->out_flight;
+	struct pcm_urb *urb = NULL;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&d->lock, flags);
+	if (!d->stopped && *flight < d->target) {
+		for (i = 0; i < PCM_N_URBS_MAX; i++) {
+			if (urbs[i].parked) {
+				urb = &urbs[i];
+				urb->parked = false;
+				urb->instance.transfer_buffer_length =
+					in ? d->in_len : d->out_len;
+				(*flight)++;
+				break;
+			}
+		}
+	}
+	spin_unlock_irqrestore(&d->lock, flags);
+	return urb;
 }
 
 static void zoom_pcm_in_urb_handler(struct urb *usb_urb)
 {
 	struct pcm_urb *in_urb = usb_urb->context;
 	struct pcm_runtime *rt = in_urb->chip->pcm;
+	struct zoom_raw *raw = in_urb->chip->raw;
+	struct zoom_timer *timer = in_urb->chip->timer;
+	const struct zoom_model *model = in_urb->chip->model;
+	u64 now = ktime_get_ns();
 	struct pcm_substream *sub;
+	struct pcm_urb *extra;
 	bool do_period_elapsed = false;
+	unsigned int frames;
 	unsigned long flags;
-	int ret;
+	u32 active;
+	int step;
+	int ret = 0;
 
 	if (rt->panic || rt->stream_state == STREAM_STOPPING)
 		return;
 
-	if (unlikely(usb_urb->status == -ENOENT ||	/* unlinked */
-		     usb_urb->status == -ENODEV ||	/* device removed */
-		     usb_urb->status == -ECONNRESET ||	/* unlinked */
-		     usb_urb->status == -ESHUTDOWN)) {	/* device disabled */
+	zoom_debug_replay_in(in_urb->chip, usb_urb);
+	if (zoom_debug_fault(in_urb->chip, usb_urb, ZOOM_URB_LOG_IN)) {
+		zoom_pcm_depth_drop(rt, in_urb, true);
+		return;
+	}
+	zoom_debug_log_urb(in_urb->chip, usb_urb, ZOOM_URB_LOG_IN, now);
+
+	/* unlinked, device removed or disabled, or a transfer error
+	 * (-EPROTO, -EOVERFLOW, ...): the data is lost */
+	if (unlikely(usb_urb->status))
 		goto out_fail;
+
+	zoom_pcm_started(rt, true, now);
+	frames = usb_urb->actual_length / zoom_frame_bytes(model);
+	if (rt->stream_state == STREAM_RUNNING) {
+		write_seqcount_begin(&rt->in_seq);
+		step = zoom_pcm_timeline(rt, &rt->in_tl, true, frames, now);
+		write_seqcount_end(&rt->in_seq);
+		if (step && READ_ONCE(dropout_fix)) {
+			spin_lock_irqsave(&rt->capture.lock, flags);
+			if (rt->capture.active)
+				rt->capture.fix += step;
+			spin_unlock_irqrestore(&rt->capture.lock, flags);
+		}
 	}
 
+	active = zoom_activity((__le32 *)in_urb->buffer, frames, model->slots,
+			       model->in_slots, model->in_channels,
+			       READ_ONCE(rt->activity_threshold));
+
+	if (raw)
+		zoom_raw_push(raw, (__le32 *)in_urb->buffer, frames, active,
+			      now);
+	if (timer)
+		zoom_timer_tick(timer, frames);
+
 	sub = &rt->capture;
 #if 1
 	spin_lock_irqsave(&sub->lock, flags);
+	zoom_pcm_sched_check(rt, sub, now, frames);
 	if (sub->active) {
-		do_period_elapsed = zoom_pcm_capture(sub, in_urb);
+		sub->activity |= active;
+		do_period_elapsed = zoom_pcm_capture(sub, in_urb,
+						     usb_urb->actual_length);
+		if (do_period_elapsed) {
+			active = sub->activity;
+			sub->activity = 0;
+		}
+	}
+	spin_unlock_irqrestore(&sub->lock, flags);
+	if (do_period_elapsed) {
+		snd_pcm_period_elapsed(sub->instance);
+		zoom_pcm_activity_update(rt, active);
 	}
+
+	sub = &rt->lowrate;
+	spin_lock_irqsave(&sub->lock, flags);
+	zoom_pcm_sched_check(rt, sub, now, frames);
+	do_period_elapsed = sub->active &&
+			    zoom_pcm_decimate(rt, sub, in_urb,
+					      usb_urb->actual_length);
 	spin_unlock_irqrestore(&sub->lock, flags);
 	if (do_period_elapsed)
 		snd_pcm_period_elapsed(sub->instance);
 
 #endif
-	ret = usb_submit_urb(&in_urb->instance, GFP_ATOMIC);
-	if (ret < 0)
-		goto out_fail;
+	/* startup intervals say nothing about the host */
+	if (rt->stream_state == STREAM_RUNNING) {
+		spin_lock_irqsave(&rt->depth.lock, flags);
+		zoom_pcm_depth_update(&rt->depth, now);
+		spin_unlock_irqrestore(&rt->depth.lock, flags);
+	}
+
+	if (zoom_pcm_depth_keep(rt, in_urb, true)) {
+		ret = usb_submit_urb(&in_urb->instance, GFP_ATOMIC);
+		if (ret < 0)
+			goto out_fail;
+	}
+
+	extra = zoom_pcm_depth_unpark(rt, true);
+	if (extra) {
+		ret = usb_submit_urb(&extra->instance, GFP_ATOMIC);
+		if (ret < 0)
+			goto out_fail;
+	}
 
 	return;
 
 out_fail:
-	rt->panic = true;
+	zoom_pcm_fail(rt, usb_urb->status ?: ret);
 }
 	
-static void zoom_pcm_out_urb_handler(struct urb *usb_urb)
+/*
+ * Playback data (or silence) for an out urb, then the same frames to the
+ * loopback capture. Sets bit 0 of the result if a playback period elapsed,
+ * bit 1 for a loopback period.
+ */
+static unsigned int zoom_pcm_out_fill(struct pcm_runtime *rt,
+				      struct pcm_urb *out_urb, u64 now)
 {
-	struct pcm_urb *out_urb = usb_urb->context;
-	struct pcm_runtime *rt = out_urb->chip->pcm;
-	struct pcm_substream *sub;
-	bool do_period_elapsed = false;
+	unsigned int bytes = out_urb->instance.transfer_buffer_length;
+	unsigned int frames = bytes / zoom_frame_bytes(rt->chip->model);
+	struct pcm_substream *sub = &rt->playback;
+	unsigned int elapsed = 0;
 	unsigned long flags;
-	int ret;
-
-	if (rt->panic || rt->stream_state == STREAM_STOPPING)
-		return;
-
-	if (unlikely(usb_urb->status == -ENOENT ||	/* unlinked */
-		     usb_urb->status == -ENODEV ||	/* device removed */
-		     usb_urb->status == -ECONNRESET ||	/* unlinked */
-		     usb_urb->status == -ESHUTDOWN)) {	/* device disabled */
-		goto out_fail;
-	}
+	u64 done_ns;
 
-	if (rt->stream_state == STREAM_STARTING) {
-		rt->stream_wait_cond = true;
-		wake_up(&rt->stream_wait_queue);
-	}
+	/* behind the other urbs in flight */
+	done_ns = now + READ_ONCE(rt->depth.out_flight) *
+			READ_ONCE(rt->depth.urb_ns);
 
-	/* now send our playback data (if a free out urb was found) */
-	sub = &rt->playback;
 	spin_lock_irqsave(&sub->lock, flags);
-
-	if (sub->active) {
-		do_period_elapsed = zoom_pcm_playback(sub, out_urb);
+	zoom_pcm_sched_check(rt, sub, done_ns, frames);
+	if (sub->active && rt->zero_copy &&
+	    zoom_pcm_playback_ring(rt, sub, out_urb)) {
+		bytes = out_urb->instance.transfer_buffer_length;
+	} else {
+		/* zero copy ahead of the application: silence */
+		zoom_pcm_urb_own(out_urb);
+		if (sub->active && !rt->zero_copy)
+			elapsed = zoom_pcm_playback(sub, out_urb);
+		else
+			memset(out_urb->buffer, 0, bytes);
 	}
-	else
-		memset(out_urb->buffer, 0, PCM_URB_SIZE);
+	spin_unlock_irqrestore(&sub->lock, flags);
 
+	sub = &rt->loopback;
+	spin_lock_irqsave(&sub->lock, flags);
+	zoom_pcm_sched_check(rt, sub, done_ns, frames);
+	if (sub->active && zoom_pcm_capture(sub, out_urb, bytes))
+		elapsed |= 2;
 	spin_unlock_irqrestore(&sub->lock, flags);
 
-	if (do_period_elapsed)
-		snd_pcm_period_elapsed(sub->instance);
+	return elapsed;
+}
 
-	ret = usb_submit_urb(&out_urb->instance, GFP_ATOMIC);
-	if (ret < 0)
-		goto out_fail;
+/* an out urb that failed to submit won't complete */
+static int zoom_pcm_out_submit(struct pcm_runtime *rt, struct pcm_urb *urb)
+{
+	int ret = usb_submit_urb(&urb->instance, GFP_ATOMIC);
 
-	return;
+	if (ret < 0 && urb->ring_frames)
+		zoom_pcm_ring_put(rt, urb);
+	return ret;
+}
+
+static void zoom_pcm_out_urb_handler(struct urb *usb_urb)
+{
+	struct pcm_urb *out_urb = usb_urb->context;
+	struct pcm_runtime *rt = out_urb->chip->pcm;
+	unsigned int ring = out_urb->ring_frames;
+	u64 now = ktime_get_ns();
+	struct pcm_urb *extra;
+	unsigned int elapsed = 0;
+	int ret = 0;
+
+	/* whatever the status, the urb is done with the playback buffer */
+	if (ring)
+		zoom_pcm_ring_put(rt, out_urb);
+
+	if (rt->panic || rt->stream_state == STREAM_STOPPING)
+		return;
+
+	if (zoom_debug_fault(out_urb->chip, usb_urb, ZOOM_URB_LOG_OUT)) {
+		zoom_pcm_depth_drop(rt, out_urb, false);
+		return;
+	}
+	zoom_debug_log_urb(out_urb->chip, usb_urb, ZOOM_URB_LOG_OUT, now);
+
+	/* stuck ring urb, see zoom_pcm_ring_release() */
+	if (unlikely(usb_urb->status == -ECONNRESET &&
+		     READ_ONCE(out_urb->ring_unlink))) {
+		WRITE_ONCE(out_urb->ring_unlink, false);
+		goto refill;
+	}
+
+	/* as in the in handler, any error status is lost data */
+	if (unlikely(usb_urb->status))
+		goto out_fail;
+
+	zoom_pcm_started(rt, false, now);
+	if (rt->stream_state == STREAM_RUNNING)
+		zoom_pcm_timeline(rt, &rt->out_tl, false, usb_urb->actual_length /
+				  zoom_frame_bytes(out_urb->chip->model), now);
+
+	if (ring && zoom_pcm_ring_done(rt, out_urb, ring))
+		elapsed = 1;
+
+refill:
+	/* now send our playback data, the queue depth follows the in side */
+	if (zoom_pcm_depth_keep(rt, out_urb, false)) {
+		elapsed |= zoom_pcm_out_fill(rt, out_urb, now);
+		ret = zoom_pcm_out_submit(rt, out_urb);
+		if (ret < 0)
+			goto out_fail;
+	}
+
+	extra = zoom_pcm_depth_unpark(rt, false);
+	if (extra) {
+		elapsed |= zoom_pcm_out_fill(rt, extra, now);
+		ret = zoom_pcm_out_submit(rt, extra);
+		if (ret < 0)
+			goto out_fail;
+	}
+
+	if (elapsed & 1)
+		snd_pcm_period_elapsed(rt->playback.instance);
+	if (elapsed & 2)
+		snd_pcm_period_elapsed(rt->loopback.instance);
+
+	return;
 
 out_fail:
-	rt->panic = true;
+	zoom_pcm_fail(rt, usb_urb->status ?: ret);
 }
 
 static int zoom_pcm_open(struct snd_pcm_substream *alsa_sub)
@@ -458,19 +1226,35 @@ static int zoom_pcm_open(struct snd_pcm_substream *alsa_sub)
 	struct pcm_runtime *rt = snd_pcm_substream_chip(alsa_sub);
 	struct pcm_substream *sub = NULL;
 	struct snd_pcm_runtime *alsa_rt = alsa_sub->runtime;
+	const struct zoom_model *model = rt->chip->model;
+	unsigned int i, rate;
+	int ret;
 
-	if (rt->panic)
-		return -EPIPE;
+	if (rt->disconnected)
+		return -ENODEV;
 
 	mutex_lock(&rt->stream_mutex);
 
-	if (alsa_sub->stream == SNDRV_PCM_STREAM_PLAYBACK) {
+	if (alsa_sub->pcm == rt->loop_instance) {
+		alsa_rt->hw = pcm_hw_rec;
+		alsa_rt->hw.channels_max = model->out_channels;
+		sub = &rt->loopback;
+	} else if (alsa_sub->pcm == rt->low_instance) {
+		alsa_rt->hw = pcm_hw_rec;
+		alsa_rt->hw.channels_max = model->in_channels;
+		sub = &rt->lowrate;
+	} else if (alsa_sub->stream == SNDRV_PCM_STREAM_PLAYBACK) {
 		alsa_rt->hw = pcm_hw;
+		alsa_rt->hw.channels_max = model->out_channels;
+		if (rt->zero_copy) { /* usb frames: every slot, S32_LE */
+			alsa_rt->hw.formats = SNDRV_PCM_FMTBIT_S32_LE;
+			alsa_rt->hw.channels_min = model->slots;
+			alsa_rt->hw.channels_max = model->slots;
+		}
 		sub = &rt->playback;
-	}
-
-	if (alsa_sub->stream == SNDRV_PCM_STREAM_CAPTURE) {
+	} else if (alsa_sub->stream == SNDRV_PCM_STREAM_CAPTURE) {
 		alsa_rt->hw = pcm_hw_rec;
+		alsa_rt->hw.channels_max = model->in_channels;
 		sub = &rt->capture;
 	}
 
@@ -481,6 +1265,33 @@ static int zoom_pcm_open(struct snd_pcm_substream *alsa_sub)
 		return -EINVAL;
 	}
 
+	if (sub == &rt->lowrate) {
+		rate = model->rates[0] / ZOOM_DECIM_FACTOR;
+		alsa_rt->hw.rates = snd_pcm_rate_to_rate_bit(rate);
+		alsa_rt->hw.rate_min = rate;
+		alsa_rt->hw.rate_max = rate;
+		ret = 0;
+	} else {
+		alsa_rt->hw.rates = 0;
+		for (i = 0; i < model->n_rates; i++)
+			alsa_rt->hw.rates |=
+				snd_pcm_rate_to_rate_bit(model->rates[i]);
+		snd_pcm_limit_hw_rates(alsa_rt);
+
+		ret = snd_pcm_hw_constraint_list(alsa_rt, 0,
+						 SNDRV_PCM_HW_PARAM_RATE,
+						 &rt->rate_list);
+	}
+	/* zero copy urbs never wrap around the buffer end */
+	if (!ret && rt->zero_copy && sub == &rt->playback)
+		ret = snd_pcm_hw_constraint_step(alsa_rt, 0,
+						 SNDRV_PCM_HW_PARAM_BUFFER_BYTES,
+						 rt->out_ep.urb_size);
+	if (ret < 0) {
+		mutex_unlock(&rt->stream_mutex);
+		return ret;
+	}
+
 	sub->instance = alsa_sub;
 	sub->active = false;
 	mutex_unlock(&rt->stream_mutex);
@@ -493,77 +1304,186 @@ static int zoom_pcm_close(struct snd_pcm_substream *alsa_sub)
 	struct pcm_substream *sub = zoom_pcm_get_substream(alsa_sub);
 	unsigned long flags;
 
-	if (rt->panic)
-		return 0;
-
 	mutex_lock(&rt->stream_mutex);
 	if (sub) {
-		zoom_pcm_stream_stop(rt);
-
 		/* deactivate substream */
 		spin_lock_irqsave(&sub->lock, flags);
 		sub->instance = NULL;
 		sub->active = false;
 		spin_unlock_irqrestore(&sub->lock, flags);
 
+		/* the other direction or /dev/zoomN may still stream */
+		if (zoom_pcm_stream_idle(rt))
+			zoom_pcm_stream_stop(rt);
 	}
 	mutex_unlock(&rt->stream_mutex);
 	return 0;
 }
 
+/* usb frame slots and count of the model channels of a substream */
+static const u8 *zoom_pcm_slots(struct pcm_runtime *rt,
+				struct pcm_substream *sub, unsigned int *n)
+{
+	const struct zoom_model *model = rt->chip->model;
+
+	if (sub == &rt->capture || sub == &rt->lowrate) {
+		*n = model->in_channels;
+		return model->in_slots;
+	}
+	*n = model->out_channels; /* playback and loopback */
+	return model->out_slots;
+}
+
+/*
+ * Call with sub->lock held, copy plan in the order of the channel map with
+ * the gain of each channel.
+ */
+static int zoom_pcm_plan(struct pcm_runtime *rt, struct pcm_substream *sub,
+			 unsigned int channels, struct zoom_plan *plan)
+{
+	u8 slot_map[ZOOM_MAX_SLOTS];
+	u32 gain[ZOOM_MAX_SLOTS];
+	const u8 *slots;
+	unsigned int n, c, ch;
+
+	slots = zoom_pcm_slots(rt, sub, &n);
+	if (channels > n)
+		return -EINVAL;
+	for (c = 0; c < channels; c++) {
+		ch = sub->order[c];
+		slot_map[c] = slots[ch];
+		gain[c] = sub->mute & BIT(ch) ? 0 : sub->gain[ch];
+	}
+
+	return zoom_plan_init(plan, sub == &rt->playback, slot_map, gain,
+			      rt->chip->model->slots, channels, sub->format);
+}
+
+/* call with sub->lock held, applies order or gain changes to the plan */
+static int zoom_pcm_replan(struct pcm_runtime *rt, struct pcm_substream *sub)
+{
+	struct zoom_plan plan;
+	int ret;
+
+	if (!sub->plan.copy)
+		return 0; /* no hw_params */
+
+	/* running streams switch at the next urb */
+	ret = zoom_pcm_plan(rt, sub, sub->plan.channels, &plan);
+	if (!ret)
+		sub->plan = plan;
+	return ret;
+}
+
+static int zoom_pcm_hw_params(struct snd_pcm_substream *alsa_sub,
+			      struct snd_pcm_hw_params *hw_params)
+{
+	struct pcm_runtime *rt = snd_pcm_substream_chip(alsa_sub);
+	struct pcm_substream *sub = zoom_pcm_get_substream(alsa_sub);
+	struct zoom_plan plan;
+	int ret;
+
+	if (!sub)
+		return -ENODEV;
+
+	spin_lock_irq(&sub->lock);
+	sub->format = params_format(hw_params);
+	if (sub == &rt->playback && rt->zero_copy) {
+		memset(&sub->plan, 0, sizeof(sub->plan)); /* nothing to copy */
+		ret = 0;
+	} else {
+		ret = zoom_pcm_plan(rt, sub, params_channels(hw_params), &plan);
+		if (!ret)
+			sub->plan = plan;
+	}
+	spin_unlock_irq(&sub->lock);
+	return ret;
+}
+
+static int zoom_pcm_hw_free(struct snd_pcm_substream *alsa_sub)
+{
+	struct pcm_runtime *rt = snd_pcm_substream_chip(alsa_sub);
+	struct pcm_substream *sub = zoom_pcm_get_substream(alsa_sub);
+
+	if (!sub)
+		return -ENODEV;
+
+	spin_lock_irq(&sub->lock);
+	sub->active = false;
+	memset(&sub->plan, 0, sizeof(sub->plan));
+	spin_unlock_irq(&sub->lock);
+
+	if (sub == &rt->playback && rt->zero_copy)
+		zoom_pcm_ring_release(rt);
+	return 0;
+}
+
 static int zoom_pcm_prepare(struct snd_pcm_substream *alsa_sub)
 {
 	struct pcm_runtime *rt = snd_pcm_substream_chip(alsa_sub);
 	struct pcm_substream *sub = zoom_pcm_get_substream(alsa_sub);
 	int ret;
 
-	if (rt->panic)
-		return -EPIPE;
 	if (!sub)
 		return -ENODEV;
 
 	mutex_lock(&rt->stream_mutex);
 
-	zoom_pcm_stream_stop(rt);
-
+	/* only this substream starts over, the running stream may carry the
+	 * other PCMs, /dev/zoomN or the timer: a loopback joins it at the
+	 * next out urb */
+	spin_lock_irq(&sub->lock);
+	sub->active = false;
+	sub->armed = false;
 	sub->dma_off = 0;
 	sub->period_off = 0;
-
-	if (rt->stream_state == STREAM_DISABLED) {
-
-		ret = zoom_pcm_stream_start(rt);
-		if (ret) {
-			mutex_unlock(&rt->stream_mutex);
-			return ret;
-		}
-	}
+	sub->ring_off = 0;
+	sub->ring_queued = 0;
+	sub->activity = 0;
+	sub->fix = 0;
+	if (sub == &rt->lowrate)
+		zoom_decim_reset(rt->decim, sub->plan.channels);
+	spin_unlock_irq(&sub->lock);
+
+	ret = zoom_pcm_stream_get(rt);
 	mutex_unlock(&rt->stream_mutex);
-	return 0;
+	return ret;
 }
 
 static int zoom_pcm_trigger(struct snd_pcm_substream *alsa_sub, int cmd)
 {
 	struct pcm_substream *sub = zoom_pcm_get_substream(alsa_sub);
 	struct pcm_runtime *rt = snd_pcm_substream_chip(alsa_sub);
+	unsigned long flags;
 
-	if (rt->panic)
-		return -EPIPE;
 	if (!sub)
 		return -ENODEV;
 
 	switch (cmd) {
 	case SNDRV_PCM_TRIGGER_START:
 	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
-		spin_lock_irq(&sub->lock);
-		sub->active = true;
-		spin_unlock_irq(&sub->lock);
+		if (rt->panic)
+			return -EPIPE;
+		spin_lock_irqsave(&sub->lock, flags);
+		/* a scheduled start waits for its urb */
+		sub->armed = cmd == SNDRV_PCM_TRIGGER_START && sub->sched_ns;
+		sub->active = !sub->armed;
+		if (cmd == SNDRV_PCM_TRIGGER_START)
+			sub->fix = 0; /* dropouts before the start */
+		/* zero copy: continue at the pointer, urbs still in flight
+		 * from before a pause don't count */
+		sub->ring_off = sub->dma_off;
+		sub->ring_queued = 0;
+		sub->ring_gen++;
+		spin_unlock_irqrestore(&sub->lock, flags);
 		return 0;
 
-	case SNDRV_PCM_TRIGGER_STOP:
+	case SNDRV_PCM_TRIGGER_STOP: /* also after a panic, from zoom_pcm_fail() */
 	case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
-		spin_lock_irq(&sub->lock);
+		spin_lock_irqsave(&sub->lock, flags);
 		sub->active = false;
-		spin_unlock_irq(&sub->lock);
+		sub->armed = false;
+		spin_unlock_irqrestore(&sub->lock, flags);
 		return 0;
 
 	default:
@@ -584,12 +1504,14 @@ static snd_pcm_uframes_t zoom_pcm_pointer(struct snd_pcm_substream *alsa_sub)
 	spin_lock_irqsave(&sub->lock, flags);
 	dma_offset = sub->dma_off;
 	spin_unlock_irqrestore(&sub->lock, flags);
-	return bytes_to_frames(alsa_sub->runtime, dma_offset);
+	return dma_offset;
 }
 
 static const struct snd_pcm_ops pcm_ops = {
 	.open = zoom_pcm_open,
 	.close = zoom_pcm_close,
+	.hw_params = zoom_pcm_hw_params,
+	.hw_free = zoom_pcm_hw_free,
 	.prepare = zoom_pcm_prepare,
 	.trigger = zoom_pcm_trigger,
 	.pointer = zoom_pcm_pointer,
@@ -597,19 +1519,19 @@ static const struct snd_pcm_ops pcm_ops = {
 
 static int zoom_pcm_init_urb_out(struct pcm_urb *urb,
 			       struct zoom_chip *chip,
-			       unsigned int ep,
+			       const struct pcm_endpoint *ep,
 			       void (*handler)(struct urb *))
 {
 	urb->chip = chip;
 	usb_init_urb(&urb->instance);
 
-	urb->buffer = kzalloc(PCM_URB_SIZE, GFP_KERNEL);
+	urb->buffer = kzalloc(ep->urb_size_max, GFP_KERNEL);
 	if (!urb->buffer)
 		return -ENOMEM;
 
 	usb_fill_bulk_urb(&urb->instance, chip->dev,
-			  usb_sndbulkpipe(chip->dev, ep), (void *)urb->buffer,
-			  PCM_URB_SIZE, handler, urb);
+			  usb_sndbulkpipe(chip->dev, ep->address),
+			  (void *)urb->buffer, ep->urb_size, handler, urb);
 	if (usb_urb_ep_type_check(&urb->instance))
 		return -EINVAL;
 	init_usb_anchor(&urb->submitted);
@@ -619,19 +1541,19 @@ static int zoom_pcm_init_urb_out(struct pcm_urb *urb,
 
 static int zoom_pcm_init_urb_in(struct pcm_urb *urb,
 			       struct zoom_chip *chip,
-			       unsigned int ep,
+			       const struct pcm_endpoint *ep,
 			       void (*handler)(struct urb *))
 {
 	urb->chip = chip;
 	usb_init_urb(&urb->instance);
 
-	urb->buffer = kzalloc(PCM_URB_SIZE, GFP_KERNEL);
+	urb->buffer = kzalloc(ep->urb_size_max, GFP_KERNEL);
 	if (!urb->buffer)
 		return -ENOMEM;
 
 	usb_fill_bulk_urb(&urb->instance, chip->dev,
-			  usb_rcvbulkpipe(chip->dev, ep), (void *)urb->buffer,
-			  PCM_URB_SIZE, handler, urb);
+			  usb_rcvbulkpipe(chip->dev, ep->address),
+			  (void *)urb->buffer, ep->urb_size, handler, urb);
 	if (usb_urb_ep_type_check(&urb->instance))
 		return -EINVAL;
 	init_usb_anchor(&urb->submitted);
@@ -639,11 +1561,390 @@ static int zoom_pcm_init_urb_in(struct pcm_urb *urb,
 	return 0;
 }
 
+/* bSubslotSize of the class specific format descriptor, 0 if there is none */
+static unsigned int zoom_alt_subslot_size(const struct usb_host_interface *alts)
+{
+	const u8 *p = alts->extra;
+	int len = alts->extralen;
+
+	while (len >= 2 && p[0] >= 2 && p[0] <= len) {
+		/* bLength, bDescriptorType, bDescriptorSubtype, bFormatType */
+		if (p[0] >= 4 && p[1] == USB_DT_CS_INTERFACE &&
+		    p[2] == UAC_FORMAT_TYPE && p[3] == UAC_FORMAT_TYPE_I) {
+			if (alts->desc.bInterfaceProtocol == UAC_VERSION_2 &&
+			    p[0] >= sizeof(struct uac2_format_type_i_descriptor))
+				return ((struct uac2_format_type_i_descriptor *)p)
+					->bSubslotSize;
+			if (p[0] >= sizeof(struct uac_format_type_i_discrete_descriptor))
+				return ((struct uac_format_type_i_discrete_descriptor *)p)
+					->bSubframeSize;
+		}
+		len -= p[0];
+		p += p[0];
+	}
+	return 0;
+}
+
+/*
+ * Pick the 32 bit alt setting and its bulk endpoint of an interface.
+ * Alt settings without format descriptors only qualify if they are the
+ * model default (vendor specific layout).
+ */
+static int zoom_pcm_find_endpoint(struct pcm_runtime *rt, u8 ifnum,
+				  u8 default_alt, bool in,
+				  struct pcm_endpoint *ep)
+{
+	struct device *device = &rt->chip->dev->dev;
+	unsigned int frame_bytes = zoom_frame_bytes(rt->chip->model);
+	struct usb_endpoint_descriptor *epd, *found_epd = NULL;
+	struct usb_host_interface *alts;
+	struct usb_interface *intf;
+	unsigned int i, subslot;
+	int ret;
+
+	intf = usb_ifnum_to_if(rt->chip->dev, ifnum);
+	if (!intf) {
+		dev_err(device, "interface %u not found\n", ifnum);
+		return -ENODEV;
+	}
+
+	for (i = 0; i < intf->num_altsetting; i++) {
+		alts = &intf->altsetting[i];
+
+		if (in)
+			ret = usb_find_bulk_in_endpoint(alts, &epd);
+		else
+			ret = usb_find_bulk_out_endpoint(alts, &epd);
+		if (ret)
+			continue;
+
+		subslot = zoom_alt_subslot_size(alts);
+		if (subslot == 4 ||
+		    (!subslot && alts->desc.bAlternateSetting == default_alt &&
+		     !found_epd)) {
+			ep->alt = alts->desc.bAlternateSetting;
+			found_epd = epd;
+			if (subslot == 4)
+				break;
+		}
+	}
+
+	if (!found_epd) {
+		dev_err(device, "no 32 bit bulk %s alt setting on interface %u\n",
+			in ? "in" : "out", ifnum);
+		return -ENODEV;
+	}
+
+	ep->ifnum = ifnum;
+	ep->address = found_epd->bEndpointAddress;
+	ep->maxpacket = usb_endpoint_maxp(found_epd);
+	if (!ep->maxpacket)
+		return -EINVAL;
+
+	/* whole packets and whole frames per urb */
+	ep->urb_size = lcm(ep->maxpacket, frame_bytes);
+	if (ep->urb_size > ZOOM_URB_SIZE_MAX) {
+		dev_err(device, "unsupported packet size %u\n", ep->maxpacket);
+		return -EINVAL;
+	}
+	ep->urb_size_max = rounddown(ZOOM_URB_SIZE_MAX, ep->urb_size);
+
+	dev_dbg(device, "%s: ep %#x alt %u/%u maxpacket %u urb %u bytes\n",
+		__func__, ep->address, ifnum, ep->alt, ep->maxpacket,
+		ep->urb_size);
+	return 0;
+}
+
+/* keep the stream running for a /dev/zoomN reader or a timer client */
+int zoom_pcm_raw_start(struct zoom_chip *chip)
+{
+	struct pcm_runtime *rt = chip->pcm;
+	int ret;
+
+	mutex_lock(&rt->stream_mutex);
+	ret = zoom_pcm_stream_get(rt);
+	if (!ret)
+		rt->raw_users++;
+	mutex_unlock(&rt->stream_mutex);
+	return ret;
+}
+
+void zoom_pcm_raw_stop(struct zoom_chip *chip)
+{
+	struct pcm_runtime *rt = chip->pcm;
+
+	mutex_lock(&rt->stream_mutex);
+	rt->raw_users--;
+	if (zoom_pcm_stream_idle(rt))
+		zoom_pcm_stream_stop(rt);
+	mutex_unlock(&rt->stream_mutex);
+}
+
+/*
+ * Device clock against CLOCK_MONOTONIC in ppb (> 0: slower), from the
+ * jitter free drift of the capture timeline. 0 until it is calibrated.
+ */
+s64 zoom_pcm_clock_ppb(struct zoom_chip *chip)
+{
+	struct pcm_runtime *rt = chip->pcm;
+	const struct pcm_timeline *tl = &rt->in_tl;
+	unsigned int seq;
+	bool calibrated;
+	s64 drift_q8;
+	u64 frames;
+
+	/* consistent with the in handler, also for u64 on 32 bit */
+	do {
+		seq = read_seqcount_begin(&rt->in_seq);
+		calibrated = tl->calibrated;
+		frames = tl->frames - tl->cal_frames;
+		drift_q8 = tl->drift_q8;
+	} while (read_seqcount_retry(&rt->in_seq, seq));
+
+	if (!calibrated || !frames)
+		return 0;
+	return div64_s64(drift_q8 * NSEC_PER_SEC, (s64)(frames << 8));
+}
+
+/* urb size of `frames` in whole packets of the endpoint */
+static unsigned int zoom_pcm_urb_len(const struct pcm_endpoint *ep,
+				     unsigned int frame_bytes,
+				     unsigned int frames)
+{
+	return clamp(roundup(frames * frame_bytes, ep->urb_size),
+		     ep->urb_size, ep->urb_size_max);
+}
+
+static struct pcm_substream *zoom_pcm_sched_sub(struct pcm_runtime *rt,
+						unsigned int n)
+{
+	struct pcm_substream *subs[ZOOM_PCM_SUBSTREAMS] = {
+		[ZOOM_SCHED_PLAYBACK] = &rt->playback,
+		[ZOOM_SCHED_CAPTURE] = &rt->capture,
+		[ZOOM_SCHED_LOOPBACK] = &rt->loopback,
+		[ZOOM_SCHED_LOWRATE] = &rt->lowrate,
+	};
+
+	return subs[n];
+}
+
+/*
+ * The next trigger start of the streams (bit n: ZOOM_SCHED_XXX) waits for
+ * `start_ns`. 0 disarms, streams that already wait start right away.
+ */
+int zoom_pcm_sched_arm(struct zoom_chip *chip, u32 streams, u64 start_ns)
+{
+	struct pcm_runtime *rt = chip->pcm;
+	struct pcm_substream *sub;
+	unsigned int n;
+
+	if (streams & ~(BIT(ZOOM_SCHED_STREAMS) - 1))
+		return -EINVAL;
+
+	for (n = 0; n < ZOOM_SCHED_STREAMS; n++) {
+		if (!(streams & BIT(n)))
+			continue;
+		sub = zoom_pcm_sched_sub(rt, n);
+		spin_lock_irq(&sub->lock);
+		sub->sched_ns = start_ns;
+		sub->started_ns = 0;
+		if (!start_ns && sub->armed) {
+			sub->armed = false;
+			sub->active = true;
+		}
+		spin_unlock_irq(&sub->lock);
+	}
+	return 0;
+}
+
+/* still armed streams, the started ones and their start times */
+void zoom_pcm_sched_status(struct zoom_chip *chip, struct zoom_sched *sched)
+{
+	struct pcm_runtime *rt = chip->pcm;
+	struct pcm_substream *sub;
+	unsigned int n;
+
+	memset(sched, 0, sizeof(*sched));
+	for (n = 0; n < ZOOM_SCHED_STREAMS; n++) {
+		sub = zoom_pcm_sched_sub(rt, n);
+		spin_lock_irq(&sub->lock);
+		if (sub->sched_ns) {
+			sched->streams |= BIT(n);
+			sched->start_ns = max(sched->start_ns, sub->sched_ns);
+		}
+		if (sub->started_ns)
+			sched->started |= BIT(n);
+		sched->started_ns[n] = sub->started_ns;
+		spin_unlock_irq(&sub->lock);
+	}
+}
+
+/* Q16 gain of each model channel and the muted ones (bit n) */
+void zoom_pcm_get_gain(struct zoom_chip *chip, bool playback, u32 *gain,
+		       u32 *mute)
+{
+	struct pcm_runtime *rt = chip->pcm;
+	struct pcm_substream *sub = playback ? &rt->playback : &rt->capture;
+
+	spin_lock_irq(&sub->lock);
+	memcpy(gain, sub->gain, sizeof(sub->gain));
+	*mute = sub->mute;
+	spin_unlock_irq(&sub->lock);
+}
+
+/* returns 1 if something changed, applied from the next urb on */
+int zoom_pcm_set_gain(struct zoom_chip *chip, bool playback,
+		      const u32 *gain, u32 mute)
+{
+	struct pcm_runtime *rt = chip->pcm;
+	struct pcm_substream *sub = playback ? &rt->playback : &rt->capture;
+	bool changed;
+	int ret = 0;
+
+	spin_lock_irq(&sub->lock);
+	changed = sub->mute != mute ||
+		  memcmp(sub->gain, gain, sizeof(sub->gain));
+	if (changed) {
+		memcpy(sub->gain, gain, sizeof(sub->gain));
+		sub->mute = mute;
+		ret = zoom_pcm_replan(rt, sub);
+	}
+	spin_unlock_irq(&sub->lock);
+
+	return ret < 0 ? ret : changed;
+}
+
+u32 zoom_pcm_get_activity(struct zoom_chip *chip)
+{
+	return READ_ONCE(chip->pcm->activity);
+}
+
+/* 16 bit scale, 0-32767 */
+unsigned int zoom_pcm_get_activity_threshold(struct zoom_chip *chip)
+{
+	return READ_ONCE(chip->pcm->activity_threshold) >> 16;
+}
+
+void zoom_pcm_set_activity_threshold(struct zoom_chip *chip,
+				     unsigned int threshold)
+{
+	WRITE_ONCE(chip->pcm->activity_threshold, min(threshold, 32767U) << 16);
+}
+
+/* playback sent from the ALSA buffer as it is, no gain applies */
+bool zoom_pcm_zero_copy(struct zoom_chip *chip)
+{
+	return chip->pcm->zero_copy;
+}
+
+unsigned int zoom_pcm_get_profile(struct zoom_chip *chip)
+{
+	return READ_ONCE(chip->pcm->depth.profile);
+}
+
+/* profile < ZOOM_PROFILE_COUNT */
+static void zoom_pcm_apply_profile(struct pcm_runtime *rt,
+				   unsigned int profile)
+{
+	const struct pcm_profile *prof = &pcm_profiles[profile];
+	const struct zoom_model *model = rt->chip->model;
+	unsigned int frame_bytes = zoom_frame_bytes(model);
+	struct pcm_depth *d = &rt->depth;
+	unsigned int min, max;
+	u64 urb_ns;
+
+	min = prof->urbs_min ?: urbs_min;
+	max = prof->urbs_max ?: urbs_max;
+	min = clamp_t(unsigned int, min, 1, PCM_N_URBS_MAX);
+	max = clamp_t(unsigned int, max, min, PCM_N_URBS_MAX);
+
+	spin_lock_irq(&d->lock);
+	d->profile = profile;
+	d->adaptive = prof->adaptive;
+	d->min = min;
+	d->max = max;
+	d->target = clamp(d->target, min, max);
+	d->in_len = zoom_pcm_urb_len(&rt->in_ep, frame_bytes, prof->urb_frames);
+	d->out_len = zoom_pcm_urb_len(&rt->out_ep, frame_bytes,
+				      prof->urb_frames);
+
+	urb_ns = div_u64((u64)d->in_len * NSEC_PER_SEC,
+			 frame_bytes * model->rates[0]);
+	d->urb_ns = urb_ns;
+	d->window_len = max_t(u64, 1, div64_u64(NSEC_PER_SEC, urb_ns));
+	d->last_ns = 0;
+	d->window = 0;
+	d->window_max_ns = 0;
+	d->quiet = 0;
+	spin_unlock_irq(&d->lock);
+}
+
+/*
+ * Takes effect while streaming: handlers park or add urbs towards the new
+ * depth and (re)submit every urb with the new size, so the switch happens
+ * at the next urb boundary of each queue.
+ */
+int zoom_pcm_set_profile(struct zoom_chip *chip, unsigned int profile)
+{
+	if (profile >= ZOOM_PROFILE_COUNT)
+		return -EINVAL;
+	zoom_pcm_apply_profile(chip->pcm, profile);
+	return 0;
+}
+
+void zoom_pcm_save(struct zoom_chip *chip, struct zoom_pcm_state *state)
+{
+	struct pcm_runtime *rt = chip->pcm;
+	struct pcm_substream *sub;
+	unsigned int n;
+
+	state->profile = zoom_pcm_get_profile(chip);
+	state->activity_threshold = zoom_pcm_get_activity_threshold(chip);
+	spin_lock_irq(&rt->depth.lock);
+	state->urbs = rt->depth.target;
+	spin_unlock_irq(&rt->depth.lock);
+
+	for (n = 0; n < ZOOM_PCM_SUBSTREAMS; n++) {
+		sub = zoom_pcm_sched_sub(rt, n);
+		spin_lock_irq(&sub->lock);
+		memcpy(state->sub[n].order, sub->order, sizeof(sub->order));
+		memcpy(state->sub[n].gain, sub->gain, sizeof(sub->gain));
+		state->sub[n].mute = sub->mute;
+		spin_unlock_irq(&sub->lock);
+	}
+}
+
+/* before the card is registered, no stream is set up yet */
+void zoom_pcm_restore(struct zoom_chip *chip,
+		      const struct zoom_pcm_state *state)
+{
+	struct pcm_runtime *rt = chip->pcm;
+	struct pcm_substream *sub;
+	unsigned int n;
+
+	zoom_pcm_set_profile(chip, state->profile);
+	zoom_pcm_set_activity_threshold(chip, state->activity_threshold);
+	/* no need to grow the queue again */
+	spin_lock_irq(&rt->depth.lock);
+	rt->depth.target = clamp(state->urbs, rt->depth.min, rt->depth.max);
+	spin_unlock_irq(&rt->depth.lock);
+
+	for (n = 0; n < ZOOM_PCM_SUBSTREAMS; n++) {
+		sub = zoom_pcm_sched_sub(rt, n);
+		spin_lock_irq(&sub->lock);
+		memcpy(sub->order, state->sub[n].order, sizeof(sub->order));
+		memcpy(sub->gain, state->sub[n].gain, sizeof(sub->gain));
+		sub->mute = state->sub[n].mute;
+		spin_unlock_irq(&sub->lock);
+	}
+}
+
 void zoom_pcm_abort(struct zoom_chip *chip)
 {
 	struct pcm_runtime *rt = chip->pcm;
 
 	if (rt) {
+		rt->disconnected = true;
 		rt->panic = true;
 
 		mutex_lock(&rt->stream_mutex);
@@ -652,15 +1953,204 @@ void zoom_pcm_abort(struct zoom_chip *chip)
 	}
 }
 
+static void zoom_pcm_proc_read(struct snd_info_entry *entry,
+			       struct snd_info_buffer *buffer)
+{
+	struct pcm_runtime *rt = entry->private_data;
+	struct pcm_depth *d = &rt->depth;
+
+	/* racy snapshot, good enough for monitoring */
+	snd_iprintf(buffer, "profile: %u (%s)\n", READ_ONCE(d->profile),
+		    READ_ONCE(d->adaptive) ? "adaptive" : "fixed");
+	snd_iprintf(buffer, "urbs in flight: %u (min %u max %u)\n",
+		    READ_ONCE(d->target), READ_ONCE(d->min),
+		    READ_ONCE(d->max));
+	snd_iprintf(buffer, "urb size: in %u out %u bytes\n",
+		    READ_ONCE(d->in_len), READ_ONCE(d->out_len));
+	snd_iprintf(buffer, "playback: %s\n",
+		    rt->zero_copy ? "zero copy" : "copy");
+	snd_iprintf(buffer, "urb interval: %llu ns\n", READ_ONCE(d->urb_ns));
+	snd_iprintf(buffer, "jitter: %llu ns\n", READ_ONCE(d->jitter_ns));
+	snd_iprintf(buffer, "max interval: %llu ns\n", READ_ONCE(d->max_ns));
+	snd_iprintf(buffer, "cold start: out %llu in %llu ns (max %llu)\n",
+		    READ_ONCE(rt->out_start_ns), READ_ONCE(rt->in_start_ns),
+		    READ_ONCE(rt->start_max_ns));
+	snd_iprintf(buffer, "discontinuities in: %lu (%llu missing, %llu extra frames)\n",
+		    READ_ONCE(rt->in_tl.events), READ_ONCE(rt->in_tl.missing),
+		    READ_ONCE(rt->in_tl.extra));
+	snd_iprintf(buffer, "discontinuities out: %lu (%llu missing, %llu extra frames)\n",
+		    READ_ONCE(rt->out_tl.events), READ_ONCE(rt->out_tl.missing),
+		    READ_ONCE(rt->out_tl.extra));
+	snd_iprintf(buffer, "clock: %+lld ppb\n", zoom_pcm_clock_ppb(rt->chip));
+	snd_iprintf(buffer, "failures: %lu (last %d)\n",
+		    READ_ONCE(rt->failures), READ_ONCE(rt->fail_status));
+	snd_iprintf(buffer, "margin violations: %lu\n",
+		    READ_ONCE(d->violations));
+	snd_iprintf(buffer, "grown: %lu\n", READ_ONCE(d->grown));
+	snd_iprintf(buffer, "shrunk: %lu\n", READ_ONCE(d->shrunk));
+}
+
+/*
+ * Channel maps: Master L/R (Out1/2) are FL/FR, the other channels have
+ * driver specific positions. Writing a map reorders (or selects) the model
+ * channels, the copy plan applies it while packing/unpacking.
+ */
+static unsigned int zoom_chmap_pos(unsigned int ch)
+{
+	if (ch < 2)
+		return ch ? SNDRV_CHMAP_FR : SNDRV_CHMAP_FL;
+	return SNDRV_CHMAP_DRIVER_SPEC | ch;
+}
+
+static struct pcm_substream *zoom_chmap_sub(struct snd_kcontrol *kctl)
+{
+	struct snd_pcm_chmap *info = snd_kcontrol_chip(kctl);
+	struct pcm_runtime *rt = info->private_data;
+
+	if (info->pcm == rt->loop_instance)
+		return &rt->loopback;
+	if (info->pcm == rt->low_instance)
+		return &rt->lowrate;
+	return info->stream == SNDRV_PCM_STREAM_PLAYBACK ? &rt->playback :
+							   &rt->capture;
+}
+
+static int zoom_chmap_info(struct snd_kcontrol *kctl,
+			   struct snd_ctl_elem_info *uinfo)
+{
+	struct snd_pcm_chmap *info = snd_kcontrol_chip(kctl);
+
+	uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	uinfo->count = info->max_channels;
+	uinfo->value.integer.min = 0;
+	uinfo->value.integer.max = SNDRV_CHMAP_DRIVER_SPEC | ZOOM_MAX_SLOTS;
+	return 0;
+}
+
+static int zoom_chmap_get(struct snd_kcontrol *kctl,
+			  struct snd_ctl_elem_value *value)
+{
+	struct snd_pcm_chmap *info = snd_kcontrol_chip(kctl);
+	struct pcm_substream *sub = zoom_chmap_sub(kctl);
+	unsigned int channels = info->max_channels;
+	unsigned int c;
+
+	spin_lock_irq(&sub->lock);
+	if (sub->plan.copy)
+		channels = sub->plan.channels;
+	for (c = 0; c < info->max_channels; c++)
+		value->value.integer.value[c] = c < channels ?
+			zoom_chmap_pos(sub->order[c]) : 0;
+	spin_unlock_irq(&sub->lock);
+	return 0;
+}
+
+/* a map of n positions: those model channels first, the others after */
+static int zoom_chmap_put(struct snd_kcontrol *kctl,
+			  struct snd_ctl_elem_value *value)
+{
+	struct snd_pcm_chmap *info = snd_kcontrol_chip(kctl);
+	struct pcm_runtime *rt = info->private_data;
+	struct pcm_substream *sub = zoom_chmap_sub(kctl);
+	unsigned int max = info->max_channels;
+	u8 order[ZOOM_MAX_SLOTS];
+	DECLARE_BITMAP(used, ZOOM_MAX_SLOTS) = { 0 };
+	unsigned int n, c, ch;
+	bool changed;
+	int ret = 0;
+
+	for (n = 0; n < max && value->value.integer.value[n]; n++) {
+		for (ch = 0; ch < max; ch++)
+			if (zoom_chmap_pos(ch) == value->value.integer.value[n])
+				break;
+		if (ch == max || test_and_set_bit(ch, used))
+			return -EINVAL;
+		order[n] = ch;
+	}
+	if (!n)
+		return -EINVAL;
+	for (ch = 0, c = n; c < max; ch++)
+		if (!test_bit(ch, used))
+			order[c++] = ch;
+
+	spin_lock_irq(&sub->lock);
+	changed = memcmp(sub->order, order, max);
+	if (sub->plan.copy && n != sub->plan.channels) {
+		ret = -EINVAL;
+	} else if (changed) {
+		memcpy(sub->order, order, max);
+		ret = zoom_pcm_replan(rt, sub);
+	}
+	spin_unlock_irq(&sub->lock);
+
+	return ret < 0 ? ret : changed;
+}
+
+/* every position list is freely permutable */
+static int zoom_chmap_tlv(struct snd_kcontrol *kctl, int op_flag,
+			  unsigned int size, unsigned int __user *tlv)
+{
+	struct snd_pcm_chmap *info = snd_kcontrol_chip(kctl);
+	unsigned int __user *dst = tlv + 2;
+	unsigned int count = 0;
+	unsigned int n, c;
+
+	if (size < 8)
+		return -ENOMEM;
+	size -= 8;
+
+	for (n = 1; n <= info->max_channels; n++) {
+		if (size < 8 + n * 4)
+			return -ENOMEM;
+		if (put_user(SNDRV_CTL_TLVT_CHMAP_VAR, dst) ||
+		    put_user(n * 4, dst + 1))
+			return -EFAULT;
+		dst += 2;
+		for (c = 0; c < n; c++)
+			if (put_user(zoom_chmap_pos(c), dst++))
+				return -EFAULT;
+		size -= 8 + n * 4;
+		count += 8 + n * 4;
+	}
+
+	if (put_user(SNDRV_CTL_TLVT_CONTAINER, tlv) ||
+	    put_user(count, tlv + 1))
+		return -EFAULT;
+	return 0;
+}
+
+static int zoom_chmap_init(struct pcm_runtime *rt, struct snd_pcm *pcm,
+			   int stream, unsigned int channels)
+{
+	struct snd_pcm_chmap *info;
+	struct snd_kcontrol *kctl;
+	int ret;
+
+	/* the callbacks below replace the ones using a fixed map table */
+	ret = snd_pcm_add_chmap_ctls(pcm, stream, NULL, channels, 0, &info);
+	if (ret < 0)
+		return ret;
+
+	info->private_data = rt;
+	kctl = info->kctl;
+	kctl->info = zoom_chmap_info;
+	kctl->get = zoom_chmap_get;
+	kctl->put = zoom_chmap_put;
+	kctl->tlv.c = zoom_chmap_tlv;
+	kctl->vd[0].access |= SNDRV_CTL_ELEM_ACCESS_WRITE;
+	return 0;
+}
+
 static void zoom_pcm_destroy(struct zoom_chip *chip)
 {
 	struct pcm_runtime *rt = chip->pcm;
 	int i;
 
-	for (i = 0; i < PCM_N_URBS; i++) {
+	for (i = 0; i < PCM_N_URBS_MAX; i++) {
 		kfree(rt->out_urbs[i].buffer);
 		kfree(rt->in_urbs[i].buffer);
 	}
+	kfree(rt->decim);
 
 	kfree(chip->pcm);
 	chip->pcm = NULL;
@@ -685,20 +2175,62 @@ int zoom_pcm_init(struct zoom_chip *chip)
 	if (!rt)
 		return -ENOMEM;
 
+	rt->decim = kzalloc(sizeof(*rt->decim), GFP_KERNEL);
+	if (!rt->decim) {
+		kfree(rt);
+		return -ENOMEM;
+	}
+
 	rt->chip = chip;
 	rt->stream_state = STREAM_DISABLED;
+	rt->rate_list.count = chip->model->n_rates;
+	rt->rate_list.list = chip->model->rates;
+	rt->activity_threshold = PCM_ACTIVITY_THRESHOLD << 16;
 
-	init_waitqueue_head(&rt->stream_wait_queue);
+	init_completion(&rt->out_started);
+	init_completion(&rt->in_started);
 	mutex_init(&rt->stream_mutex);
 	spin_lock_init(&rt->playback.lock);
 	spin_lock_init(&rt->capture.lock);
+	spin_lock_init(&rt->loopback.lock);
+	spin_lock_init(&rt->lowrate.lock);
+	for (i = 0; i < ZOOM_MAX_SLOTS; i++) {
+		rt->playback.order[i] = i;
+		rt->capture.order[i] = i;
+		rt->loopback.order[i] = i;
+		rt->lowrate.order[i] = i;
+		rt->playback.gain[i] = ZOOM_GAIN_UNITY;
+		rt->capture.gain[i] = ZOOM_GAIN_UNITY;
+		rt->loopback.gain[i] = ZOOM_GAIN_UNITY;
+		rt->lowrate.gain[i] = ZOOM_GAIN_UNITY;
+	}
+	spin_lock_init(&rt->depth.lock);
+	seqcount_init(&rt->in_seq);
 
-	ret = zoom_interface_init(rt);
+	ret = zoom_pcm_find_endpoint(rt, chip->model->out_ifnum,
+				     chip->model->out_alt, false, &rt->out_ep);
 	if (ret)
-		return ret;
+		goto error;
+
+	ret = zoom_pcm_find_endpoint(rt, chip->model->in_ifnum,
+				     chip->model->in_alt, true, &rt->in_ep);
+	if (ret)
+		goto error;
+
+	rt->depth.target = 4;
+	zoom_pcm_apply_profile(rt, ZOOM_PROFILE_BALANCED);
+
+	/* the alt settings are selected by zoom_pcm_stream_start(), on
+	 * first use, which keeps the control transfers out of probe */
+
+	rt->zero_copy = zero_copy;
+	if (zero_copy && !hcd_uses_dma(bus_to_hcd(chip->dev->bus))) {
+		dev_info(&chip->dev->dev, "no dma on this bus, zero_copy off\n");
+		rt->zero_copy = false;
+	}
 
-	for (i = 0; i < PCM_N_URBS; i++) {
-		ret = zoom_pcm_init_urb_out(&rt->out_urbs[i], chip, OUT_EP,
+	for (i = 0; i < PCM_N_URBS_MAX; i++) {
+		ret = zoom_pcm_init_urb_out(&rt->out_urbs[i], chip, &rt->out_ep,
 				    zoom_pcm_out_urb_handler);
 		if (ret < 0) {
 			printk("zoom_pcm_init_urb_out\n");
@@ -706,8 +2238,8 @@ int zoom_pcm_init(struct zoom_chip *chip)
 		}
 	}
 
-	for (i = 0; i < PCM_N_URBS; i++) {
-		ret = zoom_pcm_init_urb_in(&rt->in_urbs[i], chip, IN_EP,
+	for (i = 0; i < PCM_N_URBS_MAX; i++) {
+		ret = zoom_pcm_init_urb_in(&rt->in_urbs[i], chip, &rt->in_ep,
 				    zoom_pcm_in_urb_handler);
 		if (ret < 0) {
 			printk("zoom_pcm_init_urb_in\n");
@@ -727,19 +2259,81 @@ int zoom_pcm_init(struct zoom_chip *chip)
 	strscpy(pcm->name, "USB Audio", sizeof(pcm->name));
 	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_PLAYBACK, &pcm_ops);
 	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_CAPTURE, &pcm_ops);
+	if (rt->zero_copy) /* the out urbs dma from the playback buffer */
+		snd_pcm_set_managed_buffer(
+			pcm->streams[SNDRV_PCM_STREAM_PLAYBACK].substream,
+			SNDRV_DMA_TYPE_DEV, chip->dev->bus->sysdev, 0, 0);
+	else
+		snd_pcm_set_managed_buffer(
+			pcm->streams[SNDRV_PCM_STREAM_PLAYBACK].substream,
+			SNDRV_DMA_TYPE_VMALLOC, NULL, 0, 0);
+	snd_pcm_set_managed_buffer(
+		pcm->streams[SNDRV_PCM_STREAM_CAPTURE].substream,
+		SNDRV_DMA_TYPE_VMALLOC, NULL, 0, 0);
+
+	rt->instance = pcm;
+	chip->pcm = rt; /* freed with the card by zoom_pcm_free() from here */
+
+	/* zero copy playback sends the usb frames as they are */
+	if (!rt->zero_copy) {
+		ret = zoom_chmap_init(rt, pcm, SNDRV_PCM_STREAM_PLAYBACK,
+				      chip->model->out_channels);
+		if (ret < 0)
+			return ret;
+	}
+	ret = zoom_chmap_init(rt, pcm, SNDRV_PCM_STREAM_CAPTURE,
+			      chip->model->in_channels);
+	if (ret < 0)
+		return ret;
+
+	ret = snd_pcm_new(chip->card, "USB Loopback", 1, 0, 1, &pcm);
+	if (ret < 0) {
+		dev_err(&chip->dev->dev, "Cannot create loopback pcm\n");
+		return ret;
+	}
+
+	pcm->private_data = rt;
+	strscpy(pcm->name, "USB Loopback", sizeof(pcm->name));
+	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_CAPTURE, &pcm_ops);
 	snd_pcm_set_managed_buffer_all(pcm, SNDRV_DMA_TYPE_VMALLOC,
 				       NULL, 0, 0);
 
-	rt->instance = pcm;
+	rt->loop_instance = pcm;
+
+	ret = zoom_chmap_init(rt, pcm, SNDRV_PCM_STREAM_CAPTURE,
+			      chip->model->out_channels);
+	if (ret < 0)
+		return ret;
+
+	ret = snd_pcm_new(chip->card, "USB 16 kHz", 2, 0, 1, &pcm);
+	if (ret < 0) {
+		dev_err(&chip->dev->dev, "Cannot create low rate pcm\n");
+		return ret;
+	}
+
+	pcm->private_data = rt;
+	strscpy(pcm->name, "USB 16 kHz", sizeof(pcm->name));
+	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_CAPTURE, &pcm_ops);
+	snd_pcm_set_managed_buffer_all(pcm, SNDRV_DMA_TYPE_VMALLOC,
+				       NULL, 0, 0);
+
+	rt->low_instance = pcm;
+
+	/* selects the inputs, in any order */
+	ret = zoom_chmap_init(rt, pcm, SNDRV_PCM_STREAM_CAPTURE,
+			      chip->model->in_channels);
+	if (ret < 0)
+		return ret;
 
-	chip->pcm = rt;
+	snd_card_ro_proc_new(chip->card, "urbs", rt, zoom_pcm_proc_read);
 	return 0;
 
 error:
-	for (i = 0; i < PCM_N_URBS; i++)
+	for (i = 0; i < PCM_N_URBS_MAX; i++)
 		kfree(rt->out_urbs[i].buffer);
-	for (i = 0; i < PCM_N_URBS; i++)
+	for (i = 0; i < PCM_N_URBS_MAX; i++)
 		kfree(rt->in_urbs[i].buffer);
+	kfree(rt->decim);
 	kfree(rt);
 	return ret;
 }
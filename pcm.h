@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 /*
- * Linux driver for ZOOM devices (L-8 only at the moment)
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
  *
  * Copyright 2021 (C) Sebastian Reimers
  *
@@ -11,8 +11,51 @@
 #ifndef ZOOM_PCM_H
 #define ZOOM_PCM_H
 
+#include "driver.h" /* ZOOM_MAX_SLOTS */
+
 struct zoom_chip;
+struct zoom_sched;
+
+enum { /* latency profiles, see pcm_profiles in pcm.c */
+	ZOOM_PROFILE_ULTRA_LOW,
+	ZOOM_PROFILE_BALANCED,
+	ZOOM_PROFILE_ROBUST,
+	ZOOM_PROFILE_COUNT
+};
+
+#define ZOOM_PCM_SUBSTREAMS 4 /* in ZOOM_SCHED_XXX order, see uapi.h */
+
+/* settings kept for a replugged device, see zoom_identity in driver.c */
+struct zoom_pcm_state {
+	unsigned int profile;
+	unsigned int urbs; /* learned queue depth */
+	unsigned int activity_threshold;
+	struct {
+		u8 order[ZOOM_MAX_SLOTS];
+		u32 gain[ZOOM_MAX_SLOTS];
+		u32 mute;
+	} sub[ZOOM_PCM_SUBSTREAMS];
+};
 
 int zoom_pcm_init(struct zoom_chip *chip);
 void zoom_pcm_abort(struct zoom_chip *chip);
+void zoom_pcm_save(struct zoom_chip *chip, struct zoom_pcm_state *state);
+void zoom_pcm_restore(struct zoom_chip *chip,
+		      const struct zoom_pcm_state *state);
+int zoom_pcm_raw_start(struct zoom_chip *chip);
+void zoom_pcm_raw_stop(struct zoom_chip *chip);
+int zoom_pcm_sched_arm(struct zoom_chip *chip, u32 streams, u64 start_ns);
+void zoom_pcm_sched_status(struct zoom_chip *chip, struct zoom_sched *sched);
+void zoom_pcm_get_gain(struct zoom_chip *chip, bool playback, u32 *gain,
+		       u32 *mute);
+int zoom_pcm_set_gain(struct zoom_chip *chip, bool playback,
+		      const u32 *gain, u32 mute);
+s64 zoom_pcm_clock_ppb(struct zoom_chip *chip);
+u32 zoom_pcm_get_activity(struct zoom_chip *chip);
+unsigned int zoom_pcm_get_activity_threshold(struct zoom_chip *chip);
+void zoom_pcm_set_activity_threshold(struct zoom_chip *chip,
+				     unsigned int threshold);
+bool zoom_pcm_zero_copy(struct zoom_chip *chip);
+unsigned int zoom_pcm_get_profile(struct zoom_chip *chip);
+int zoom_pcm_set_profile(struct zoom_chip *chip, unsigned int profile);
 #endif /* ZOOM_PCM_H */
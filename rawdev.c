@@ -0,0 +1,364 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * /dev/zoomN: all live capture channels with URB timestamps, see uapi.h
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#include <linux/fs.h>
+#include <linux/kref.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/splice.h>
+#include <linux/uio.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+
+#include "driver.h"
+#include "pcm.h"
+#include "pack.h"
+#include "rawdev.h"
+#include "uapi.h"
+
+static unsigned int raw_records = 1024;
+module_param(raw_records, uint, 0444);
+MODULE_PARM_DESC(raw_records, "URB records in the /dev/zoomN ring.");
+
+struct zoom_raw {
+	struct kref kref; /* chip, open files and mappings */
+	struct mutex lock;
+	struct zoom_chip *chip; /* NULL after disconnect, protected by lock */
+	bool disconnected;
+
+	struct miscdevice misc;
+	char name[16];
+	wait_queue_head_t wait;
+
+	struct zoom_plan plan; /* all live inputs, S32_LE */
+	struct zoom_raw_header *hdr;
+	u8 *data;
+};
+
+struct zoom_raw_reader {
+	struct zoom_raw *raw;
+	u64 pos; /* next record to read */
+};
+
+static struct zoom_raw_record *zoom_raw_record(struct zoom_raw *raw, u64 n)
+{
+	return (struct zoom_raw_record *)(raw->data +
+		(n & (raw->hdr->records - 1)) * raw->hdr->record_size);
+}
+
+/* called from the in urb handler, the only producer */
+void zoom_raw_push(struct zoom_raw *raw, __le32 *urb, unsigned int frames,
+		   u32 active, u64 tstamp_ns)
+{
+	u64 head = raw->hdr->head;
+	struct zoom_raw_record *rec = zoom_raw_record(raw, head);
+
+	frames = min(frames, raw->hdr->frames);
+
+	WRITE_ONCE(rec->seq, ~0ULL);
+	smp_wmb(); /* invalidate before overwriting */
+	rec->tstamp_ns = tstamp_ns;
+	rec->frames = frames;
+	rec->active = active;
+	raw->plan.copy(&raw->plan, rec + 1, urb, frames);
+	smp_wmb(); /* data before seq */
+	WRITE_ONCE(rec->seq, head);
+	smp_store_release(&raw->hdr->head, head + 1);
+
+	if (wq_has_sleeper(&raw->wait))
+		wake_up_interruptible(&raw->wait);
+}
+
+static void zoom_raw_free(struct kref *kref)
+{
+	struct zoom_raw *raw = container_of(kref, struct zoom_raw, kref);
+
+	vfree(raw->hdr);
+	kfree(raw);
+}
+
+static int zoom_raw_open(struct inode *inode, struct file *file)
+{
+	struct zoom_raw *raw = container_of(file->private_data,
+					    struct zoom_raw, misc);
+	struct zoom_raw_reader *reader;
+	int ret;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	mutex_lock(&raw->lock);
+	if (!raw->chip) {
+		ret = -ENODEV;
+		goto err;
+	}
+
+	ret = zoom_pcm_raw_start(raw->chip);
+	if (ret)
+		goto err;
+
+	kref_get(&raw->kref);
+	reader->raw = raw;
+	reader->pos = smp_load_acquire(&raw->hdr->head);
+	mutex_unlock(&raw->lock);
+
+	file->private_data = reader;
+	return nonseekable_open(inode, file);
+
+err:
+	mutex_unlock(&raw->lock);
+	kfree(reader);
+	return ret;
+}
+
+static int zoom_raw_release(struct inode *inode, struct file *file)
+{
+	struct zoom_raw_reader *reader = file->private_data;
+	struct zoom_raw *raw = reader->raw;
+
+	mutex_lock(&raw->lock);
+	if (raw->chip)
+		zoom_pcm_raw_stop(raw->chip);
+	mutex_unlock(&raw->lock);
+
+	kfree(reader);
+	kref_put(&raw->kref, zoom_raw_free);
+	return 0;
+}
+
+/* returns bytes copied, 0 if the reader has seen everything */
+static ssize_t zoom_raw_copy(struct zoom_raw_reader *reader,
+			     struct iov_iter *to)
+{
+	struct zoom_raw *raw = reader->raw;
+	size_t size = raw->hdr->record_size;
+	struct zoom_raw_record *rec;
+	ssize_t done = 0;
+	u64 head, seq;
+
+	head = smp_load_acquire(&raw->hdr->head);
+	while (reader->pos != head && iov_iter_count(to) >= size) {
+		/* overrun: the producer never waits, skip to the oldest */
+		if (head - reader->pos > raw->hdr->records)
+			reader->pos = head - raw->hdr->records;
+
+		rec = zoom_raw_record(raw, reader->pos);
+		seq = READ_ONCE(rec->seq);
+		smp_rmb();
+		if (seq == reader->pos) {
+			if (copy_to_iter(rec, size, to) != size)
+				return done ?: -EFAULT;
+			smp_rmb();
+			if (READ_ONCE(rec->seq) == seq)
+				done += size;
+			else
+				iov_iter_revert(to, size);
+		}
+		reader->pos++;
+	}
+	return done;
+}
+
+static ssize_t zoom_raw_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *file = iocb->ki_filp;
+	struct zoom_raw_reader *reader = file->private_data;
+	struct zoom_raw *raw = reader->raw;
+	ssize_t ret;
+
+	if (iov_iter_count(to) < raw->hdr->record_size)
+		return -EINVAL;
+
+	for (;;) {
+		ret = zoom_raw_copy(reader, to);
+		if (ret)
+			return ret;
+
+		if (READ_ONCE(raw->disconnected))
+			return -ENODEV;
+		if ((file->f_flags & O_NONBLOCK) ||
+		    (iocb->ki_flags & IOCB_NOWAIT))
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(raw->wait,
+			smp_load_acquire(&raw->hdr->head) != reader->pos ||
+			READ_ONCE(raw->disconnected));
+		if (ret)
+			return ret;
+	}
+}
+
+static __poll_t zoom_raw_poll(struct file *file, poll_table *wait)
+{
+	struct zoom_raw_reader *reader = file->private_data;
+	struct zoom_raw *raw = reader->raw;
+
+	poll_wait(file, &raw->wait, wait);
+
+	if (READ_ONCE(raw->disconnected))
+		return EPOLLERR | EPOLLHUP;
+	if (smp_load_acquire(&raw->hdr->head) != reader->pos)
+		return EPOLLIN | EPOLLRDNORM;
+	return 0;
+}
+
+static void zoom_raw_vm_open(struct vm_area_struct *vma)
+{
+	struct zoom_raw *raw = vma->vm_private_data;
+
+	kref_get(&raw->kref);
+}
+
+static void zoom_raw_vm_close(struct vm_area_struct *vma)
+{
+	struct zoom_raw *raw = vma->vm_private_data;
+
+	kref_put(&raw->kref, zoom_raw_free);
+}
+
+static const struct vm_operations_struct zoom_raw_vm_ops = {
+	.open = zoom_raw_vm_open,
+	.close = zoom_raw_vm_close,
+};
+
+/* read only mapping of the header page and the record ring */
+static int zoom_raw_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct zoom_raw_reader *reader = file->private_data;
+	struct zoom_raw *raw = reader->raw;
+	int ret;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	ret = remap_vmalloc_range(vma, raw->hdr, vma->vm_pgoff);
+	if (ret)
+		return ret;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+	vma->vm_ops = &zoom_raw_vm_ops;
+	vma->vm_private_data = raw;
+	zoom_raw_vm_open(vma);
+	return 0;
+}
+
+static const struct file_operations zoom_raw_fops = {
+	.owner = THIS_MODULE,
+	.open = zoom_raw_open,
+	.release = zoom_raw_release,
+	.read_iter = zoom_raw_read_iter,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+	.splice_read = copy_splice_read,
+#else
+	.splice_read = generic_file_splice_read,
+#endif
+	.poll = zoom_raw_poll,
+	.mmap = zoom_raw_mmap,
+};
+
+int zoom_raw_init(struct zoom_chip *chip)
+{
+	const struct zoom_model *model = chip->model;
+	unsigned int frames = ZOOM_URB_SIZE_MAX / zoom_frame_bytes(model);
+	struct zoom_raw_header *hdr;
+	struct zoom_raw *raw;
+	size_t record_size;
+	unsigned int records;
+	int ret;
+
+	raw = kzalloc(sizeof(*raw), GFP_KERNEL);
+	if (!raw)
+		return -ENOMEM;
+
+	kref_init(&raw->kref);
+	mutex_init(&raw->lock);
+	init_waitqueue_head(&raw->wait);
+	raw->chip = chip;
+
+	ret = zoom_plan_init(&raw->plan, false, model->in_slots, NULL,
+			     model->slots, model->in_channels,
+			     SNDRV_PCM_FORMAT_S32_LE);
+	if (ret)
+		goto err_free;
+
+	records = roundup_pow_of_two(clamp(raw_records, 16U, 65536U));
+	record_size = ALIGN(sizeof(struct zoom_raw_record) +
+			    frames * model->in_channels * 4, 64);
+
+	hdr = vmalloc_user(PAGE_SIZE + records * record_size);
+	if (!hdr) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+
+	hdr->magic = ZOOM_RAW_MAGIC;
+	hdr->version = ZOOM_RAW_VERSION;
+	hdr->channels = model->in_channels;
+	hdr->frames = frames;
+	hdr->record_size = record_size;
+	hdr->records = records;
+	hdr->rate = model->rates[0];
+	hdr->data_offset = PAGE_SIZE;
+	raw->hdr = hdr;
+	raw->data = (u8 *)hdr + PAGE_SIZE;
+
+	snprintf(raw->name, sizeof(raw->name), "zoom%d", chip->card->number);
+	raw->misc.minor = MISC_DYNAMIC_MINOR;
+	raw->misc.name = raw->name;
+	raw->misc.fops = &zoom_raw_fops;
+	raw->misc.parent = &chip->dev->dev;
+
+	ret = misc_register(&raw->misc);
+	if (ret) {
+		dev_err(&chip->dev->dev, "cannot register /dev/%s\n",
+			raw->name);
+		goto err_vfree;
+	}
+
+	chip->raw = raw;
+	return 0;
+
+err_vfree:
+	vfree(hdr);
+err_free:
+	kfree(raw);
+	return ret;
+}
+
+/* call after the urbs are stopped */
+void zoom_raw_disconnect(struct zoom_chip *chip)
+{
+	struct zoom_raw *raw = chip->raw;
+
+	if (!raw)
+		return;
+
+	misc_deregister(&raw->misc);
+
+	mutex_lock(&raw->lock);
+	raw->chip = NULL;
+	mutex_unlock(&raw->lock);
+
+	WRITE_ONCE(raw->disconnected, true);
+	wake_up_interruptible_all(&raw->wait);
+
+	chip->raw = NULL;
+	kref_put(&raw->kref, zoom_raw_free);
+}
@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#ifndef ZOOM_RAWDEV_H
+#define ZOOM_RAWDEV_H
+
+#include <linux/types.h>
+
+struct zoom_chip;
+struct zoom_raw;
+
+int zoom_raw_init(struct zoom_chip *chip);
+void zoom_raw_disconnect(struct zoom_chip *chip);
+void zoom_raw_push(struct zoom_raw *raw, __le32 *urb, unsigned int frames,
+		   u32 active, u64 tstamp_ns);
+#endif /* ZOOM_RAWDEV_H */
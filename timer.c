@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * ALSA timer ticking on the device sample clock: every `frames` captured
+ * frames, counted in the IN urb completions.
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <sound/core.h>
+#include <sound/timer.h>
+
+#include "driver.h"
+#include "pcm.h"
+#include "timer.h"
+
+#define TIMER_FRAMES_DEFAULT 48 /* 1 ms at 48 kHz */
+
+struct zoom_timer {
+	struct zoom_chip *chip;
+	struct snd_timer *instance;
+
+	spinlock_t lock;
+	bool running;
+	unsigned int frames; /* per tick */
+	unsigned int acc;    /* frames since the last tick */
+};
+
+/* from the in urb handler */
+void zoom_timer_tick(struct zoom_timer *t, unsigned int frames)
+{
+	unsigned long flags;
+	unsigned int ticks;
+
+	if (!READ_ONCE(t->running))
+		return;
+
+	spin_lock_irqsave(&t->lock, flags);
+	t->acc += frames;
+	ticks = t->acc / t->frames;
+	t->acc %= t->frames;
+	spin_unlock_irqrestore(&t->lock, flags);
+
+	if (ticks)
+		snd_timer_interrupt(t->instance, ticks);
+}
+
+/* the first client starts the stream, as a /dev/zoomN reader does */
+static int zoom_timer_open(struct snd_timer *timer)
+{
+	struct zoom_timer *t = timer->private_data;
+
+	return zoom_pcm_raw_start(t->chip);
+}
+
+static int zoom_timer_close(struct snd_timer *timer)
+{
+	struct zoom_timer *t = timer->private_data;
+
+	zoom_pcm_raw_stop(t->chip);
+	return 0;
+}
+
+static int zoom_timer_start(struct snd_timer *timer)
+{
+	struct zoom_timer *t = timer->private_data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&t->lock, flags);
+	t->acc = 0;
+	t->running = true;
+	spin_unlock_irqrestore(&t->lock, flags);
+	return 0;
+}
+
+static int zoom_timer_stop(struct snd_timer *timer)
+{
+	struct zoom_timer *t = timer->private_data;
+
+	WRITE_ONCE(t->running, false);
+	return 0;
+}
+
+/* ns per tick of the device clock, follows its drift */
+static unsigned long zoom_timer_resolution(struct snd_timer *timer)
+{
+	struct zoom_timer *t = timer->private_data;
+	u64 res;
+
+	res = div_u64((u64)READ_ONCE(t->frames) * NSEC_PER_SEC,
+		      t->chip->model->rates[0]);
+	res += div_s64((s64)res * zoom_pcm_clock_ppb(t->chip), NSEC_PER_SEC);
+	return res;
+}
+
+static const struct snd_timer_hardware zoom_timer_hw = {
+	.flags = SNDRV_TIMER_HW_AUTO,
+	.ticks = 100000000, /* max ticks per period */
+	.open = zoom_timer_open,
+	.close = zoom_timer_close,
+	.start = zoom_timer_start,
+	.stop = zoom_timer_stop,
+	.c_resolution = zoom_timer_resolution,
+};
+
+unsigned int zoom_timer_get_frames(struct zoom_chip *chip)
+{
+	return READ_ONCE(chip->timer->frames);
+}
+
+/* applies from the next tick on */
+void zoom_timer_set_frames(struct zoom_chip *chip, unsigned int frames)
+{
+	struct zoom_timer *t = chip->timer;
+	unsigned long flags;
+
+	spin_lock_irqsave(&t->lock, flags);
+	t->frames = clamp_t(unsigned int, frames, 1, ZOOM_TIMER_FRAMES_MAX);
+	spin_unlock_irqrestore(&t->lock, flags);
+}
+
+static void zoom_timer_free(struct snd_timer *timer)
+{
+	struct zoom_timer *t = timer->private_data;
+
+	t->chip->timer = NULL;
+	kfree(t);
+}
+
+/* call before snd_card_register(), freed with the card */
+int zoom_timer_init(struct zoom_chip *chip)
+{
+	struct snd_timer_id tid = {
+		.dev_class = SNDRV_TIMER_CLASS_CARD,
+		.dev_sclass = SNDRV_TIMER_SCLASS_NONE,
+		.card = chip->card->number,
+		.device = 0,
+		.subdevice = 0,
+	};
+	struct snd_timer *timer;
+	struct zoom_timer *t;
+	int ret;
+
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+	t->chip = chip;
+	t->frames = TIMER_FRAMES_DEFAULT;
+	spin_lock_init(&t->lock);
+
+	ret = snd_timer_new(chip->card, "ZOOM", &tid, &timer);
+	if (ret < 0) {
+		kfree(t);
+		return ret;
+	}
+
+	strscpy(timer->name, "ZOOM LiveTrak sample clock", sizeof(timer->name));
+	timer->hw = zoom_timer_hw;
+	timer->private_data = t;
+	timer->private_free = zoom_timer_free;
+	t->instance = timer;
+	chip->timer = t;
+	return 0;
+}
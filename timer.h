@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#ifndef ZOOM_TIMER_H
+#define ZOOM_TIMER_H
+
+#include <linux/types.h>
+
+#define ZOOM_TIMER_FRAMES_MAX 48000
+
+struct zoom_chip;
+struct zoom_timer;
+
+int zoom_timer_init(struct zoom_chip *chip);
+void zoom_timer_tick(struct zoom_timer *t, unsigned int frames);
+unsigned int zoom_timer_get_frames(struct zoom_chip *chip);
+void zoom_timer_set_frames(struct zoom_chip *chip, unsigned int frames);
+#endif /* ZOOM_TIMER_H */
@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * The few kernel definitions pack.c uses, so the tools can build the
+ * driver's copy plans and pack kernels unchanged (see zoom-replay and
+ * zoom-packbench).
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#ifndef ZOOM_KCOMPAT_H
+#define ZOOM_KCOMPAT_H
+
+#include <endian.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/types.h>
+#include <sound/asound.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+
+#define ZOOM_MAX_SLOTS 32 /* as in driver.h */
+
+#define S32_MIN INT32_MIN
+#define S32_MAX INT32_MAX
+
+#define BIT(n)        (1UL << (n))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define clamp_t(type, val, lo, hi) ({				\
+	type __v = (val), __lo = (lo), __hi = (hi);		\
+	__v < __lo ? __lo : __v > __hi ? __hi : __v;		\
+})
+
+#define GFP_KERNEL 0
+#define kmalloc(size, gfp) malloc(size)
+#define kfree(p)           free(p)
+
+#define pr_info(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
+#define pr_warn(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
+
+static inline void get_random_bytes(void *buf, size_t len)
+{
+	u8 *p = buf;
+
+	while (len--)
+		*p++ = rand();
+}
+
+/* no FPU state to save in userspace, the asm only has to declare it */
+#if defined(__x86_64__) || defined(__i386__)
+#define CONFIG_X86 1
+#define X86_FEATURE_XMM2 "sse2"
+#define X86_FEATURE_AVX  "avx"
+#define X86_FEATURE_AVX2 "avx2"
+#define boot_cpu_has(f)    __builtin_cpu_supports(f)
+#define may_use_simd()     true
+#define kernel_fpu_begin() do { } while (0)
+#define kernel_fpu_end()   do { } while (0)
+#define ZOOM_XMM_CLOBBERS  , "xmm0", "xmm1"
+#endif
+
+#define cpu_to_le32(x) ((__le32)htole32(x))
+#define le32_to_cpu(x) le32toh((__u32)(x))
+#define cpu_to_le16(x) ((__le16)htole16(x))
+#define le16_to_cpu(x) le16toh((__u16)(x))
+
+#endif /* ZOOM_KCOMPAT_H */
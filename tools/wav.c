@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * tools: WAV/RF64 header writer
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#include <string.h>
+#include <strings.h>
+
+#include "wav.h"
+
+#define WAVE_FORMAT_PCM        0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xfffe
+
+#define WAV_DS64_OFF  12 /* ds64/JUNK chunk, 28 bytes payload */
+#define WAV_FMT_OFF   48 /* fmt chunk, 40 bytes payload */
+#define WAV_PAD_OFF   96 /* JUNK up to the data chunk */
+#define WAV_DATA_OFF  (WAV_HEADER_SIZE - 8)
+
+static const struct {
+	const char *name;
+	unsigned int bytes;
+} wav_formats[] = {
+	[WAV_S16] = { "s16", 2 },
+	[WAV_S24] = { "s24", 3 },
+	[WAV_S32] = { "s32", 4 },
+	[WAV_F32] = { "f32", 4 },
+};
+
+unsigned int wav_sample_bytes(enum wav_format format)
+{
+	return wav_formats[format].bytes;
+}
+
+int wav_format_parse(const char *name, enum wav_format *format)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(wav_formats) / sizeof(wav_formats[0]); i++) {
+		if (!strcasecmp(name, wav_formats[i].name)) {
+			*format = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	put_le16(p, v);
+	put_le16(p + 2, v >> 16);
+}
+
+static void put_le64(uint8_t *p, uint64_t v)
+{
+	put_le32(p, v);
+	put_le32(p + 4, v >> 32);
+}
+
+static void put_chunk(uint8_t *p, const char *id, uint32_t size)
+{
+	memcpy(p, id, 4);
+	put_le32(p + 4, size);
+}
+
+uint64_t wav_file_size(uint64_t data_bytes)
+{
+	return WAV_HEADER_SIZE + data_bytes + (data_bytes & 1);
+}
+
+void wav_header(void *buf, const struct wav_fmt *fmt, uint64_t data_bytes)
+{
+	unsigned int bytes = wav_sample_bytes(fmt->format);
+	unsigned int block_align = bytes * fmt->channels;
+	uint64_t riff_size = wav_file_size(data_bytes) - 8;
+	bool rf64 = riff_size > UINT32_MAX;
+	uint8_t *p = buf;
+	uint32_t mask;
+
+	memset(buf, 0, WAV_HEADER_SIZE);
+
+	put_chunk(p, rf64 ? "RF64" : "RIFF", rf64 ? UINT32_MAX : riff_size);
+	memcpy(p + 8, "WAVE", 4);
+
+	put_chunk(p + WAV_DS64_OFF, rf64 ? "ds64" : "JUNK", 28);
+	if (rf64) {
+		put_le64(p + WAV_DS64_OFF + 8, riff_size);
+		put_le64(p + WAV_DS64_OFF + 16, data_bytes);
+		put_le64(p + WAV_DS64_OFF + 24, data_bytes / block_align);
+		/* table length 0 */
+	}
+
+	/* WAVE_FORMAT_EXTENSIBLE, like test.wav */
+	if (fmt->channels == 1)
+		mask = 0x4; /* front center */
+	else if (fmt->channels == 2)
+		mask = 0x3; /* front left, right */
+	else
+		mask = 0; /* no speaker positions, these are tracks */
+
+	p += WAV_FMT_OFF;
+	put_chunk(p, "fmt ", 40);
+	put_le16(p + 8, WAVE_FORMAT_EXTENSIBLE);
+	put_le16(p + 10, fmt->channels);
+	put_le32(p + 12, fmt->rate);
+	put_le32(p + 16, fmt->rate * block_align);
+	put_le16(p + 20, block_align);
+	put_le16(p + 22, bytes * 8);
+	put_le16(p + 24, 22);
+	put_le16(p + 26, bytes * 8); /* valid bits */
+	put_le32(p + 28, mask);
+	/* KSDATAFORMAT_SUBTYPE_PCM/IEEE_FLOAT: 0000xxxx-0000-0010-8000-00aa00389b71 */
+	put_le16(p + 32, fmt->format == WAV_F32 ? WAVE_FORMAT_IEEE_FLOAT :
+						   WAVE_FORMAT_PCM);
+	memcpy(p + 38, "\x10\x00\x80\x00\x00\xaa\x00\x38\x9b\x71", 10);
+
+	p = (uint8_t *)buf + WAV_PAD_OFF;
+	put_chunk(p, "JUNK", WAV_DATA_OFF - WAV_PAD_OFF - 8);
+
+	p = (uint8_t *)buf + WAV_DATA_OFF;
+	put_chunk(p, "data", rf64 ? UINT32_MAX : data_bytes);
+}
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * tools: WAV/RF64 header writer
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#ifndef ZOOM_TOOLS_WAV_H
+#define ZOOM_TOOLS_WAV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * The header always takes one 4 KiB block so the sample data starts block
+ * aligned (O_DIRECT). It carries a ds64 chunk, as JUNK while the file
+ * fits a RIFF WAV, so it can switch to RF64 in place once data passes 4 GiB.
+ */
+#define WAV_HEADER_SIZE 4096
+
+enum wav_format {
+	WAV_S16,
+	WAV_S24, /* packed, 3 bytes */
+	WAV_S32,
+	WAV_F32,
+};
+
+struct wav_fmt {
+	enum wav_format format;
+	unsigned int channels;
+	unsigned int rate;
+};
+
+unsigned int wav_sample_bytes(enum wav_format format);
+int wav_format_parse(const char *name, enum wav_format *format);
+
+/* fills buf[WAV_HEADER_SIZE] for data_bytes of sample data */
+void wav_header(void *buf, const struct wav_fmt *fmt, uint64_t data_bytes);
+
+/* bytes of the complete file, RIFF pad byte included */
+uint64_t wav_file_size(uint64_t data_bytes);
+
+#endif /* ZOOM_TOOLS_WAV_H */
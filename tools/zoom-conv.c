@@ -0,0 +1,427 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * zoom-conv: raw captures -> WAV/RF64
+ *
+ * Inputs: raw URB dumps (frames of `slots` S32 slots), debugfs urb_log
+ * recordings (see uapi.h) or interleaved S32 streams as the capture PCM
+ * delivers them. The input is mmapped and cut into segments, worker threads
+ * convert the segments straight into the mmapped output file(s).
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "uapi.h"
+#include "wav.h"
+
+#define MAX_CHANNELS   32
+#define SEGMENT_FRAMES 65536 /* unit of work of one thread */
+#define CHUNK_FRAMES   256   /* rows converted per pass, stays in L1 */
+
+enum input_type {
+	INPUT_S32, /* interleaved S32_LE, -C channels */
+	INPUT_URB, /* raw URB payload, -S slots per frame */
+	INPUT_ZRL, /* debugfs urb_log, IN records */
+};
+
+struct segment {
+	const int32_t *src;
+	uint64_t frames;
+	uint64_t out_frame; /* first output frame */
+};
+
+static struct {
+	enum input_type input;
+	unsigned int in_channels;
+	unsigned int rate;
+	enum wav_format format;
+	bool split;
+	unsigned int threads;
+	bool quiet;
+	unsigned int sel[MAX_CHANNELS]; /* input channel of each output one */
+	unsigned int n_sel;
+} opt = {
+	.input = INPUT_S32,
+	.rate = 48000,
+	.format = WAV_S32,
+};
+
+static struct segment *segs;
+static size_t n_segs, segs_alloc;
+static uint64_t total_frames;
+
+static uint8_t *out_base[MAX_CHANNELS]; /* sample data of selected channel k */
+static unsigned int out_stride;         /* bytes per output frame */
+static size_t next_seg;                 /* work queue, atomic */
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static void seg_add(const int32_t *src, uint64_t frames)
+{
+	uint64_t n;
+
+	while (frames) {
+		if (n_segs == segs_alloc) {
+			segs_alloc = segs_alloc ? segs_alloc * 2 : 1024;
+			segs = realloc(segs, segs_alloc * sizeof(*segs));
+			if (!segs)
+				die("realloc");
+		}
+		n = frames < SEGMENT_FRAMES ? frames : SEGMENT_FRAMES;
+		segs[n_segs++] = (struct segment){
+			.src = src,
+			.frames = n,
+			.out_frame = total_frames,
+		};
+		src += n * opt.in_channels;
+		frames -= n;
+		total_frames += n;
+	}
+}
+
+/* urb_log: one segment per IN record, only the record headers are read */
+static int index_zrl(const uint8_t *p, size_t size)
+{
+	const struct zoom_urb_log_header *h = (const void *)p;
+	unsigned int frame_bytes;
+	size_t off;
+
+	if (size < sizeof(*h) || h->magic != ZOOM_URB_LOG_MAGIC ||
+	    h->version != ZOOM_URB_LOG_VERSION || !h->slots ||
+	    h->slots > MAX_CHANNELS) {
+		fprintf(stderr, "not an urb_log recording\n");
+		return -1;
+	}
+	opt.in_channels = h->slots;
+	opt.rate = h->rate;
+	frame_bytes = h->slots * 4;
+
+	for (off = sizeof(*h); off + sizeof(struct zoom_urb_log_record) <= size;) {
+		const struct zoom_urb_log_record *rec = (const void *)(p + off);
+		const int32_t *payload = (const void *)(rec + 1);
+		unsigned int frames = rec->length / frame_bytes;
+
+		off += sizeof(*rec) + rec->length;
+		if (off > size)
+			break; /* truncated */
+		if (rec->dir != ZOOM_URB_LOG_IN || rec->status || !frames)
+			continue;
+		seg_add(payload, frames);
+	}
+	return 0;
+}
+
+/* s32 sample (24 bit in the upper bytes) -> output format */
+#define CONV_LOOP(type, expr)						\
+	do {								\
+		for (f = 0; f < n; f++) {				\
+			int32_t v = src[f * sstride];			\
+			*(type *)(dst + f * dstride) = (expr);		\
+		}							\
+	} while (0)
+
+static void conv(uint8_t *dst, unsigned int dstride, const int32_t *src,
+		 unsigned int sstride, size_t n)
+{
+	size_t f;
+
+	switch (opt.format) {
+	case WAV_S16:
+		CONV_LOOP(int16_t, v >> 16);
+		break;
+	case WAV_S32:
+		CONV_LOOP(int32_t, v);
+		break;
+	case WAV_F32:
+		CONV_LOOP(float, v * (1.0f / 2147483648.0f));
+		break;
+	case WAV_S24:
+		for (f = 0; f < n; f++) {
+			uint32_t v = src[f * sstride];
+			uint8_t *d = dst + f * dstride;
+
+			d[0] = v >> 8;
+			d[1] = v >> 16;
+			d[2] = v >> 24;
+		}
+		break;
+	}
+}
+
+static void convert_segment(const struct segment *seg)
+{
+	uint64_t f, n;
+	unsigned int k;
+
+	for (f = 0; f < seg->frames; f += n) {
+		const int32_t *src = seg->src + f * opt.in_channels;
+		uint64_t out = seg->out_frame + f;
+
+		n = seg->frames - f;
+		if (n > CHUNK_FRAMES)
+			n = CHUNK_FRAMES;
+		for (k = 0; k < opt.n_sel; k++)
+			conv(out_base[k] + out * out_stride, out_stride,
+			     src + opt.sel[k], opt.in_channels, n);
+	}
+}
+
+static void *worker(void *arg)
+{
+	size_t i;
+
+	(void)arg;
+	while ((i = __atomic_fetch_add(&next_seg, 1, __ATOMIC_RELAXED)) < n_segs)
+		convert_segment(&segs[i]);
+	return NULL;
+}
+
+static uint8_t *output_map(const char *path, const struct wav_fmt *fmt,
+			   uint64_t data_bytes, size_t *size)
+{
+	uint8_t *p;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die(path);
+	*size = wav_file_size(data_bytes);
+	if (ftruncate(fd, *size))
+		die(path);
+	p = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		die("mmap");
+	close(fd);
+
+	wav_header(p, fmt, data_bytes);
+	return p;
+}
+
+/* "1-4,7" -> opt.sel (0 based) */
+static int parse_channels(const char *s)
+{
+	char *end;
+	long a, b;
+
+	opt.n_sel = 0;
+	while (*s) {
+		a = strtol(s, &end, 10);
+		b = a;
+		if (*end == '-')
+			b = strtol(end + 1, &end, 10);
+		if (end == s || a < 1 || b < a || b > MAX_CHANNELS ||
+		    opt.n_sel + (b - a + 1) > MAX_CHANNELS)
+			return -1;
+		while (a <= b)
+			opt.sel[opt.n_sel++] = a++ - 1;
+		s = end;
+		if (*s == ',')
+			s++;
+		else if (*s)
+			return -1;
+	}
+	return opt.n_sel ? 0 : -1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options] input output\n"
+		"  -i type   input: s32 (interleaved, default), urb (raw URB dump),\n"
+		"            zrl (debugfs urb_log recording)\n"
+		"  -C n      s32: channels per frame (default 12)\n"
+		"  -S n      urb: 32 bit slots per frame (default 32)\n"
+		"  -r rate   sample rate (default 48000, zrl: from the file)\n"
+		"  -c list   channels to convert, 1 based (\"1-4,7\", default all)\n"
+		"  -f fmt    s16, s24, s32 or f32 (default s32)\n"
+		"  -s        one file per channel: output-NN.wav\n"
+		"  -j n      threads (default: online cpus)\n"
+		"  -q        no throughput report\n", prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *sel_list = NULL, *in_path, *out_path;
+	pthread_t threads[64];
+	size_t in_size, out_size[MAX_CHANNELS];
+	uint8_t *out_map[MAX_CHANNELS];
+	unsigned int bytes, k, n_out;
+	struct wav_fmt fmt;
+	struct stat stbuf;
+	uint8_t *in;
+	double t0, t1;
+	int fd, c;
+
+	opt.threads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((c = getopt(argc, argv, "i:C:S:r:c:f:sj:qh")) != -1) {
+		switch (c) {
+		case 'i':
+			if (!strcmp(optarg, "s32"))
+				opt.input = INPUT_S32;
+			else if (!strcmp(optarg, "urb"))
+				opt.input = INPUT_URB;
+			else if (!strcmp(optarg, "zrl"))
+				opt.input = INPUT_ZRL;
+			else
+				usage(argv[0]);
+			break;
+		case 'C':
+		case 'S':
+			opt.in_channels = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			opt.rate = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			sel_list = optarg;
+			break;
+		case 'f':
+			if (wav_format_parse(optarg, &opt.format))
+				usage(argv[0]);
+			break;
+		case 's':
+			opt.split = true;
+			break;
+		case 'j':
+			opt.threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			opt.quiet = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!opt.in_channels)
+		opt.in_channels = opt.input == INPUT_URB ? 32 : 12;
+	if (argc - optind != 2 ||
+	    opt.in_channels > MAX_CHANNELS || !opt.rate)
+		usage(argv[0]);
+	if (!opt.threads)
+		opt.threads = 1;
+	if (opt.threads > 64)
+		opt.threads = 64;
+	in_path = argv[optind];
+	out_path = argv[optind + 1];
+
+	fd = open(in_path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &stbuf))
+		die(in_path);
+	in_size = stbuf.st_size;
+	if (!in_size) {
+		fprintf(stderr, "%s: empty\n", in_path);
+		return 1;
+	}
+	in = mmap(NULL, in_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (in == MAP_FAILED)
+		die("mmap");
+	madvise(in, in_size, MADV_SEQUENTIAL);
+	close(fd);
+
+	t0 = now_s();
+	if (opt.input == INPUT_ZRL) {
+		if (index_zrl(in, in_size))
+			return 1;
+	} else {
+		seg_add((const int32_t *)in, in_size / (opt.in_channels * 4));
+	}
+
+	if (sel_list) {
+		if (parse_channels(sel_list))
+			usage(argv[0]);
+	} else {
+		for (k = 0; k < opt.in_channels; k++)
+			opt.sel[k] = k;
+		opt.n_sel = opt.in_channels;
+	}
+	for (k = 0; k < opt.n_sel; k++) {
+		if (opt.sel[k] >= opt.in_channels) {
+			fprintf(stderr, "channel %u: input has %u channels\n",
+				opt.sel[k] + 1, opt.in_channels);
+			return 1;
+		}
+	}
+
+	bytes = wav_sample_bytes(opt.format);
+	fmt.format = opt.format;
+	fmt.rate = opt.rate;
+	if (opt.split) {
+		char path[PATH_MAX];
+		const char *ext = strrchr(out_path, '.');
+		int base = ext && !strcmp(ext, ".wav") ? ext - out_path :
+							 (int)strlen(out_path);
+
+		fmt.channels = 1;
+		out_stride = bytes;
+		n_out = opt.n_sel;
+		for (k = 0; k < n_out; k++) {
+			snprintf(path, sizeof(path), "%.*s-%02u.wav", base,
+				 out_path, opt.sel[k] + 1);
+			out_map[k] = output_map(path, &fmt, total_frames * bytes,
+						&out_size[k]);
+			out_base[k] = out_map[k] + WAV_HEADER_SIZE;
+		}
+	} else {
+		fmt.channels = opt.n_sel;
+		out_stride = bytes * opt.n_sel;
+		n_out = 1;
+		out_map[0] = output_map(out_path, &fmt,
+					total_frames * out_stride, &out_size[0]);
+		for (k = 0; k < opt.n_sel; k++)
+			out_base[k] = out_map[0] + WAV_HEADER_SIZE + k * bytes;
+	}
+
+	for (k = 0; k < opt.threads; k++)
+		if (pthread_create(&threads[k], NULL, worker, NULL))
+			die("pthread_create");
+	for (k = 0; k < opt.threads; k++)
+		pthread_join(threads[k], NULL);
+
+	for (k = 0; k < n_out; k++)
+		munmap(out_map[k], out_size[k]);
+	t1 = now_s();
+	munmap(in, in_size);
+
+	if (!opt.quiet)
+		fprintf(stderr, "%llu frames (%.1f s audio), %u -> %u channels "
+			"%s, %.1f MB in %.3f s: %.0f MB/s, %u threads\n",
+			(unsigned long long)total_frames,
+			(double)total_frames / opt.rate, opt.in_channels,
+			opt.n_sel, opt.split ? "per file" : "interleaved",
+			in_size / 1e6, t1 - t0, in_size / 1e6 / (t1 - t0),
+			opt.threads);
+	return 0;
+}
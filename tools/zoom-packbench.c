@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * zoom-packbench: checks the pack/unpack kernels of pack.c (built
+ * unchanged) bit for bit against the scalar reference and times them per
+ * channel count and urb size
+ *
+ * Besides the kernels it times the driver's copy plan for the same layout
+ * (S32, linear slots, unity gain): the per channel count copy below
+ * ZOOM_PACK_SIMD_FRAMES, the selected kernel from there on. Userspace has
+ * no FPU state to save, the in-kernel cost of kernel_fpu_begin() comes on
+ * top of the SIMD numbers.
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pack.h"
+
+#define MAX_LIST 16
+
+static struct {
+	unsigned int frames[MAX_LIST]; /* per urb */
+	unsigned int n_frames;
+	unsigned int channels[MAX_LIST];
+	unsigned int n_channels;
+	unsigned long total; /* frames per measurement */
+} opt = {
+	.frames = { 4, 32, 128 },
+	.n_frames = 3,
+	.total = 4000000,
+};
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int parse_list(const char *s, unsigned int *list, unsigned int *n,
+		      unsigned int max)
+{
+	char *end;
+
+	*n = 0;
+	while (*s && *n < MAX_LIST) {
+		list[*n] = strtoul(s, &end, 10);
+		if (end == s || !list[*n] || list[*n] > max)
+			return -1;
+		(*n)++;
+		s = *end == ',' ? end + 1 : end;
+	}
+	return *s || !*n ? -1 : 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -u list   frames per urb (default 4,32,128)\n"
+		"  -c list   channel counts (default 1,2,4,12,14,22)\n"
+		"  -n n      frames per measurement (default %lu)\n"
+		"exit 1 if a kernel doesn't match the scalar path\n",
+		prog, opt.total);
+	exit(2);
+}
+
+struct bench {
+	u32 *urb, *pcm;
+	unsigned int frames, channels;
+};
+
+/* ns per frame of unpack (pack = false) or pack, kernel or plan */
+static double bench_ops(const struct zoom_pack_ops *ops, bool pack,
+			const struct bench *b)
+{
+	unsigned long i, loops = opt.total / b->frames ?: 1;
+	double t = now_ns();
+
+	for (i = 0; i < loops; i++) {
+		if (pack)
+			ops->pack(b->urb, b->pcm, b->frames,
+				  ZOOM_PACK_TEST_SLOTS, 0, b->channels);
+		else
+			ops->unpack(b->pcm, b->urb, b->frames,
+				    ZOOM_PACK_TEST_SLOTS, 0, b->channels);
+	}
+	return (now_ns() - t) / (loops * b->frames);
+}
+
+static double bench_plan(const struct zoom_plan *plan, const struct bench *b)
+{
+	unsigned long i, loops = opt.total / b->frames ?: 1;
+	double t = now_ns();
+
+	for (i = 0; i < loops; i++)
+		plan->copy(plan, b->pcm, (__le32 *)b->urb, b->frames);
+	return (now_ns() - t) / (loops * b->frames);
+}
+
+int main(int argc, char **argv)
+{
+	const struct zoom_pack_ops *ops, *scalar = NULL;
+	struct zoom_plan plan_in, plan_out;
+	u8 slot_map[ZOOM_MAX_SLOTS];
+	struct zoom_pack_test *t;
+	double ref_un, ref_pk, un, pk;
+	unsigned int i, k, c, f;
+	struct bench b;
+	int ret = 0;
+
+	for (k = 0; k < zoom_pack_n_test_channels; k++)
+		opt.channels[k] = zoom_pack_test_channels[k];
+	opt.n_channels = zoom_pack_n_test_channels;
+
+	while ((c = getopt(argc, argv, "u:c:n:h")) != (unsigned int)-1) {
+		switch (c) {
+		case 'u':
+			if (parse_list(optarg, opt.frames, &opt.n_frames,
+				       65536))
+				usage(argv[0]);
+			break;
+		case 'c':
+			if (parse_list(optarg, opt.channels, &opt.n_channels,
+				       ZOOM_PACK_TEST_SLOTS))
+				usage(argv[0]);
+			break;
+		case 'n':
+			opt.total = strtoul(optarg, NULL, 0);
+			if (!opt.total)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+
+	/* the driver's selection, with its self-test */
+	if (zoom_pack_init())
+		return 1;
+
+	t = malloc(sizeof(*t));
+	if (!t)
+		return 1;
+	for (k = 0; k < ARRAY_SIZE(t->frames); k++) {
+		t->frames[k] = rand();
+		t->pcm[k] = rand();
+	}
+	for (i = 0; (ops = zoom_pack_algo(i)); i++) {
+		if (ops->usable && !ops->usable())
+			continue;
+		if (!ops->simd)
+			scalar = ops;
+		for (k = 0; k < opt.n_channels; k++) {
+			if (zoom_pack_check(ops, t, opt.channels[k]))
+				continue;
+			printf("%s: %u channels differ from scalar\n",
+			       ops->name, opt.channels[k]);
+			ret = 1;
+		}
+	}
+	free(t);
+
+	f = 0;
+	for (k = 0; k < opt.n_frames; k++)
+		f = opt.frames[k] > f ? opt.frames[k] : f;
+	b.urb = calloc((size_t)f * ZOOM_PACK_TEST_SLOTS, 4);
+	b.pcm = calloc((size_t)f * ZOOM_PACK_TEST_SLOTS, 4);
+	if (!b.urb || !b.pcm || !scalar)
+		return 1;
+	for (k = 0; k < ZOOM_PACK_TEST_SLOTS; k++)
+		slot_map[k] = k;
+
+	printf("# %s selected, simd from %u frames\n",
+	       zoom_pack_selected()->name, ZOOM_PACK_SIMD_FRAMES);
+	printf("%3s %6s %-7s %9s %6s %9s %6s\n", "ch", "frames", "kernel",
+	       "unpack ns", "x", "pack ns", "x");
+	for (k = 0; k < opt.n_channels; k++) {
+		b.channels = opt.channels[k];
+		if (zoom_plan_init(&plan_in, false, slot_map, NULL,
+				   ZOOM_PACK_TEST_SLOTS, b.channels,
+				   SNDRV_PCM_FORMAT_S32_LE) ||
+		    zoom_plan_init(&plan_out, true, slot_map, NULL,
+				   ZOOM_PACK_TEST_SLOTS, b.channels,
+				   SNDRV_PCM_FORMAT_S32_LE))
+			return 1;
+
+		for (f = 0; f < opt.n_frames; f++) {
+			b.frames = opt.frames[f];
+			ref_un = bench_ops(scalar, false, &b);
+			ref_pk = bench_ops(scalar, true, &b);
+
+			/* ns per frame, speedup against scalar */
+			for (i = 0; (ops = zoom_pack_algo(i)); i++) {
+				if (ops->usable && !ops->usable())
+					continue;
+				un = ops == scalar ? ref_un :
+				     bench_ops(ops, false, &b);
+				pk = ops == scalar ? ref_pk :
+				     bench_ops(ops, true, &b);
+				printf("%3u %6u %-7s %9.2f %6.2f %9.2f %6.2f\n",
+				       b.channels, b.frames, ops->name, un,
+				       ref_un / un, pk, ref_pk / pk);
+			}
+			un = bench_plan(&plan_in, &b);
+			pk = bench_plan(&plan_out, &b);
+			printf("%3u %6u %-7s %9.2f %6.2f %9.2f %6.2f\n",
+			       b.channels, b.frames, "plan", un, ref_un / un,
+			       pk, ref_pk / pk);
+		}
+	}
+
+	free(b.urb);
+	free(b.pcm);
+	return ret;
+}
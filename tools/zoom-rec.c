@@ -0,0 +1,736 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * zoom-rec: multitrack recorder, /dev/zoomN -> one WAV/RF64 file per input
+ *
+ * Follows the mmapped /dev/zoomN ring (see uapi.h), splits the frames into
+ * per-channel blocks and writes them with io_uring and O_DIRECT. Ring
+ * overruns (xruns) and disk write latency are reported once a second and
+ * at the end.
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "uapi.h"
+#include "wav.h"
+
+#define BLOCK_ALIGN 4096 /* O_DIRECT offset/length/buffer alignment */
+#define ZOOM_MAX_CHANNELS 32
+
+struct block {
+	void *buf;
+	unsigned int track;
+	bool busy;
+	uint64_t submit_ns;
+};
+
+struct track {
+	int fd;
+	char path[PATH_MAX];
+	uint64_t data_bytes; /* written or in flight */
+	unsigned int next;   /* next block of this track */
+	size_t fill;         /* frames in the current block */
+};
+
+struct uring {
+	int fd;
+	unsigned int entries;
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+};
+
+struct stats {
+	uint64_t records;
+	uint64_t frames;
+	uint64_t xruns;        /* ring overruns */
+	uint64_t lost_records;
+	uint64_t writes;
+	uint64_t lat_sum_ns;
+	uint64_t lat_max_ns;
+	uint64_t lat_hist[32]; /* log2 us buckets */
+	uint64_t urb_gap_max_ns;
+	uint64_t stalls;       /* waits for a free block */
+};
+
+static struct {
+	const char *device;
+	const char *dir;
+	const char *prefix;
+	enum wav_format format;
+	double duration;
+	size_t block_kb;
+	unsigned int depth;
+	bool direct;
+	bool quiet;
+} opt = {
+	.device = "/dev/zoom0",
+	.dir = ".",
+	.prefix = "track",
+	.format = WAV_S32,
+	.block_kb = 1024,
+	.depth = 4,
+	.direct = true,
+};
+
+static volatile sig_atomic_t stop;
+
+static struct zoom_raw_header *hdr;
+static const uint8_t *ring;
+static unsigned int channels;
+static struct track *tracks;
+static struct block *blocks; /* depth blocks per track */
+static size_t block_frames;
+static int32_t *scratch;     /* s24: split target before packing */
+static struct uring uring;
+static bool use_uring;
+static unsigned int inflight;
+static struct stats st;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+/* io_uring via raw syscalls, only IORING_OP_WRITE is used */
+static int uring_init(struct uring *u, unsigned int entries)
+{
+	struct io_uring_params p;
+	size_t sq_size, cq_size;
+	uint8_t *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	u->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (u->fd < 0)
+		return -errno;
+
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_size > sq_size)
+			sq_size = cq_size;
+		cq_size = sq_size;
+	}
+
+	sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		goto err;
+	cq = sq;
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			goto err;
+	}
+	u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		       u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED)
+		goto err;
+
+	u->entries = p.sq_entries;
+	u->sq_head = (unsigned int *)(sq + p.sq_off.head);
+	u->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+	u->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned int *)(sq + p.sq_off.array);
+	u->cq_head = (unsigned int *)(cq + p.cq_off.head);
+	u->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+	u->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+
+err:
+	close(u->fd);
+	return -errno;
+}
+
+static int uring_write(struct uring *u, int fd, const void *buf, size_t len,
+		       uint64_t off, uint64_t user_data)
+{
+	unsigned int tail = *u->sq_tail;
+	unsigned int idx = tail & *u->sq_mask;
+	struct io_uring_sqe *sqe = &u->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = len;
+	sqe->off = off;
+	sqe->user_data = user_data;
+	u->sq_array[idx] = idx;
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	if (syscall(__NR_io_uring_enter, u->fd, 1, 0, 0, NULL, 0) < 0)
+		return -errno;
+	return 0;
+}
+
+/* calls fn for every completion, waits for at least `wait` of them */
+static int uring_reap(struct uring *u, unsigned int wait,
+		      void (*fn)(uint64_t user_data, int res))
+{
+	unsigned int head, n = 0;
+
+	for (;;) {
+		head = *u->cq_head;
+		while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+			struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+
+			fn(cqe->user_data, cqe->res);
+			head++;
+			n++;
+		}
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+		if (n >= wait)
+			return n;
+		if (syscall(__NR_io_uring_enter, u->fd, 0, wait - n,
+			    IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+		    errno != EINTR)
+			return -errno;
+	}
+}
+
+static void write_done(uint64_t user_data, int res)
+{
+	struct block *b = &blocks[user_data];
+	uint64_t lat = now_ns() - b->submit_ns;
+	unsigned int bucket = 0;
+
+	if (res < 0) {
+		fprintf(stderr, "%s: write: %s\n", tracks[b->track].path,
+			strerror(-res));
+		exit(1);
+	}
+
+	st.writes++;
+	st.lat_sum_ns += lat;
+	if (lat > st.lat_max_ns)
+		st.lat_max_ns = lat;
+	for (lat /= 1000; lat && bucket < 31; lat >>= 1)
+		bucket++;
+	st.lat_hist[bucket]++;
+
+	b->busy = false;
+	inflight--;
+}
+
+static void block_submit(unsigned int t, struct block *b, size_t len)
+{
+	struct track *tr = &tracks[t];
+	uint64_t off = WAV_HEADER_SIZE + tr->data_bytes;
+	ssize_t ret;
+
+	b->busy = true;
+	b->submit_ns = now_ns();
+	inflight++;
+
+	if (use_uring) {
+		ret = uring_write(&uring, tr->fd, b->buf, len, off, b - blocks);
+		if (ret < 0) {
+			fprintf(stderr, "io_uring_enter: %s\n",
+				strerror(-ret));
+			exit(1);
+		}
+		return;
+	}
+
+	ret = pwrite(tr->fd, b->buf, len, off);
+	write_done(b - blocks, ret == (ssize_t)len ? (int)ret :
+			       ret < 0 ? -errno : -EIO);
+}
+
+static void wait_writes(unsigned int n)
+{
+	if (use_uring && uring_reap(&uring, n, write_done) < 0) {
+		perror("io_uring_enter");
+		exit(1);
+	}
+}
+
+static struct block *track_block(unsigned int t)
+{
+	struct block *b = &blocks[t * opt.depth + tracks[t].next];
+
+	while (b->busy) {
+		/* the disk is behind, this is where ring overruns come from */
+		st.stalls++;
+		wait_writes(1);
+	}
+	return b;
+}
+
+/*
+ * Deinterleave frames of `channels` S32 samples into one array per
+ * channel. SSE2 transposes 4 channels x 4 frames per step.
+ */
+static void split(int32_t *const *dest, size_t off, const int32_t *src,
+		  size_t frames)
+{
+	unsigned int c = 0;
+	size_t f;
+
+#if defined(__SSE2__)
+	for (; c + 4 <= channels; c += 4) {
+		int32_t *d0 = dest[c] + off, *d1 = dest[c + 1] + off;
+		int32_t *d2 = dest[c + 2] + off, *d3 = dest[c + 3] + off;
+		const int32_t *s = src + c;
+
+		for (f = 0; f + 4 <= frames; f += 4, s += 4 * channels) {
+			__m128i r0 = _mm_loadu_si128((const __m128i *)s);
+			__m128i r1 = _mm_loadu_si128((const __m128i *)(s + channels));
+			__m128i r2 = _mm_loadu_si128((const __m128i *)(s + 2 * channels));
+			__m128i r3 = _mm_loadu_si128((const __m128i *)(s + 3 * channels));
+			__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+			__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+			__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+			__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+			_mm_storeu_si128((__m128i *)(d0 + f), _mm_unpacklo_epi64(t0, t1));
+			_mm_storeu_si128((__m128i *)(d1 + f), _mm_unpackhi_epi64(t0, t1));
+			_mm_storeu_si128((__m128i *)(d2 + f), _mm_unpacklo_epi64(t2, t3));
+			_mm_storeu_si128((__m128i *)(d3 + f), _mm_unpackhi_epi64(t2, t3));
+		}
+		for (; f < frames; f++, s += channels) {
+			d0[f] = s[0];
+			d1[f] = s[1];
+			d2[f] = s[2];
+			d3[f] = s[3];
+		}
+	}
+#endif
+	for (; c < channels; c++) {
+		int32_t *d = dest[c] + off;
+
+		for (f = 0; f < frames; f++)
+			d[f] = src[f * channels + c];
+	}
+}
+
+/* S32 (24 bit in the upper bytes) -> packed S24 */
+static void pack_s24(uint8_t *dest, const int32_t *src, size_t frames)
+{
+	size_t f;
+
+	for (f = 0; f < frames; f++) {
+		uint32_t v = (uint32_t)src[f];
+
+		dest[3 * f] = v >> 8;
+		dest[3 * f + 1] = v >> 16;
+		dest[3 * f + 2] = v >> 24;
+	}
+}
+
+static void tracks_push(const int32_t *src, size_t frames)
+{
+	unsigned int bytes = wav_sample_bytes(opt.format);
+	int32_t *dest[ZOOM_MAX_CHANNELS];
+	unsigned int t;
+	size_t n, fill;
+
+	while (frames) {
+		fill = tracks[0].fill; /* the same for all tracks */
+		n = block_frames - fill;
+		if (n > frames)
+			n = frames;
+
+		for (t = 0; t < channels; t++) {
+			struct block *b = track_block(t);
+
+			if (opt.format == WAV_S32)
+				dest[t] = b->buf;
+			else
+				dest[t] = scratch + t * block_frames;
+		}
+		split(dest, fill, src, n);
+		if (opt.format == WAV_S24) {
+			for (t = 0; t < channels; t++)
+				pack_s24((uint8_t *)track_block(t)->buf +
+					 fill * bytes, dest[t] + fill, n);
+		}
+
+		for (t = 0; t < channels; t++) {
+			struct track *tr = &tracks[t];
+
+			tr->fill += n;
+			if (tr->fill < block_frames)
+				continue;
+			block_submit(t, track_block(t), block_frames * bytes);
+			tr->data_bytes += block_frames * bytes;
+			tr->next = (tr->next + 1) % opt.depth;
+			tr->fill = 0;
+		}
+
+		src += n * channels;
+		frames -= n;
+	}
+}
+
+/* copies record n out of the ring, false if the producer overwrote it */
+static bool record_get(uint64_t n, struct zoom_raw_record *dest)
+{
+	const struct zoom_raw_record *rec = (const void *)(ring +
+		(n & (hdr->records - 1)) * hdr->record_size);
+	uint64_t seq;
+
+	seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+	if (seq != n)
+		return false;
+	memcpy(dest, rec, hdr->record_size);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&rec->seq, __ATOMIC_RELAXED) == n &&
+	       dest->frames <= hdr->frames;
+}
+
+static void tracks_open(void)
+{
+	size_t block_bytes = opt.block_kb * 1024;
+	unsigned int bytes = wav_sample_bytes(opt.format);
+	struct wav_fmt fmt = {
+		.format = opt.format,
+		.channels = 1,
+		.rate = hdr->rate,
+	};
+	unsigned int t, i;
+	void *buf;
+
+	block_frames = block_bytes / bytes;
+	tracks = calloc(channels, sizeof(*tracks));
+	blocks = calloc((size_t)channels * opt.depth, sizeof(*blocks));
+	scratch = calloc((size_t)channels * block_frames, sizeof(int32_t));
+	if (!tracks || !blocks || !scratch ||
+	    posix_memalign(&buf, BLOCK_ALIGN, WAV_HEADER_SIZE)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	wav_header(buf, &fmt, 0);
+
+	for (t = 0; t < channels; t++) {
+		struct track *tr = &tracks[t];
+
+		snprintf(tr->path, sizeof(tr->path), "%s/%s-%02u.wav",
+			 opt.dir, opt.prefix, t + 1);
+		tr->fd = open(tr->path, O_WRONLY | O_CREAT | O_TRUNC |
+			      (opt.direct ? O_DIRECT : 0), 0644);
+		if (tr->fd < 0 && opt.direct && errno == EINVAL) {
+			fprintf(stderr, "%s: no O_DIRECT support, "
+				"using buffered writes\n", tr->path);
+			opt.direct = false;
+			tr->fd = open(tr->path, O_WRONLY | O_CREAT | O_TRUNC,
+				      0644);
+		}
+		if (tr->fd < 0) {
+			perror(tr->path);
+			exit(1);
+		}
+		if (pwrite(tr->fd, buf, WAV_HEADER_SIZE, 0) != WAV_HEADER_SIZE) {
+			perror(tr->path);
+			exit(1);
+		}
+
+		for (i = 0; i < opt.depth; i++) {
+			struct block *b = &blocks[t * opt.depth + i];
+
+			if (posix_memalign(&b->buf, BLOCK_ALIGN, block_bytes)) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+			/* fault in now, not in the capture loop */
+			memset(b->buf, 0, block_bytes);
+			b->track = t;
+		}
+	}
+	free(buf);
+}
+
+/* writes the partial blocks (padded to BLOCK_ALIGN) and final headers */
+static void tracks_close(void)
+{
+	unsigned int bytes = wav_sample_bytes(opt.format);
+	struct wav_fmt fmt = {
+		.format = opt.format,
+		.channels = 1,
+		.rate = hdr->rate,
+	};
+	unsigned int t;
+	void *buf;
+
+	for (t = 0; t < channels; t++) {
+		struct track *tr = &tracks[t];
+		size_t len = tr->fill * bytes;
+		struct block *b;
+
+		if (!len)
+			continue;
+		b = track_block(t);
+		memset((uint8_t *)b->buf + len, 0,
+		       (len + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN - len);
+		block_submit(t, b, (len + BLOCK_ALIGN - 1) / BLOCK_ALIGN *
+				   BLOCK_ALIGN);
+		tr->data_bytes += len;
+	}
+	wait_writes(inflight);
+
+	if (posix_memalign(&buf, BLOCK_ALIGN, WAV_HEADER_SIZE)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (t = 0; t < channels; t++) {
+		struct track *tr = &tracks[t];
+
+		wav_header(buf, &fmt, tr->data_bytes);
+		if (ftruncate(tr->fd, wav_file_size(tr->data_bytes)) ||
+		    pwrite(tr->fd, buf, WAV_HEADER_SIZE, 0) != WAV_HEADER_SIZE ||
+		    fsync(tr->fd) || close(tr->fd))
+			perror(tr->path);
+	}
+	free(buf);
+}
+
+static uint64_t lat_percentile(unsigned int pct)
+{
+	uint64_t n = 0, want = (st.writes * pct + 99) / 100;
+	unsigned int i;
+
+	for (i = 0; i < 32; i++) {
+		n += st.lat_hist[i];
+		if (n >= want)
+			return i ? 1ULL << i : 1; /* bucket upper bound, us */
+	}
+	return 0;
+}
+
+static void report(FILE *f, const char *end)
+{
+	double secs = (double)st.frames / hdr->rate;
+
+	fprintf(f, "%02u:%02u:%02u  xruns %" PRIu64 " (%" PRIu64
+		" urbs lost)  writes %" PRIu64 "  lat avg %.2f ms p99 <%.2f ms "
+		"max %.2f ms  stalls %" PRIu64 "  urb gap max %.2f ms%s",
+		(unsigned int)secs / 3600, (unsigned int)secs / 60 % 60,
+		(unsigned int)secs % 60, st.xruns, st.lost_records, st.writes,
+		st.writes ? st.lat_sum_ns / 1e6 / st.writes : 0.0,
+		lat_percentile(99) / 1e3, st.lat_max_ns / 1e6, st.stalls,
+		st.urb_gap_max_ns / 1e6, end);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -D dev     raw capture device (default /dev/zoom0)\n"
+		"  -o dir     output directory (default .)\n"
+		"  -p prefix  file name prefix, files are prefix-NN.wav\n"
+		"  -f fmt     s32 or s24 (default s32)\n"
+		"  -d secs    stop after secs seconds (default: SIGINT)\n"
+		"  -b kib     write block size per track (default 1024)\n"
+		"  -q n       blocks in flight per track (default 4)\n"
+		"  -B         buffered writes instead of O_DIRECT\n"
+		"  -s         no periodic status line\n", prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct zoom_raw_record *rec;
+	uint64_t pos, head, last_ts = 0, last_report, now, max_frames;
+	struct zoom_raw_header h;
+	size_t map_size, frames;
+	void *map;
+	int fd, c, ret, unit;
+
+	while ((c = getopt(argc, argv, "D:o:p:f:d:b:q:Bsh")) != -1) {
+		switch (c) {
+		case 'D':
+			opt.device = optarg;
+			break;
+		case 'o':
+			opt.dir = optarg;
+			break;
+		case 'p':
+			opt.prefix = optarg;
+			break;
+		case 'f':
+			if (wav_format_parse(optarg, &opt.format) ||
+			    (opt.format != WAV_S32 && opt.format != WAV_S24))
+				usage(argv[0]);
+			break;
+		case 'd':
+			opt.duration = atof(optarg);
+			break;
+		case 'b':
+			opt.block_kb = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			opt.depth = strtoul(optarg, NULL, 0);
+			break;
+		case 'B':
+			opt.direct = false;
+			break;
+		case 's':
+			opt.quiet = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	/* whole samples and whole BLOCK_ALIGN units per block */
+	unit = opt.format == WAV_S24 ? 12 : 4;
+	opt.block_kb = (opt.block_kb + unit - 1) / unit * unit;
+	if (!opt.depth || opt.depth > 64 || opt.block_kb > 65536)
+		usage(argv[0]);
+
+	fd = open(opt.device, O_RDONLY);
+	if (fd < 0) {
+		perror(opt.device);
+		return 1;
+	}
+	/* read() returns records, the header is only in the mapping */
+	map = mmap(NULL, sizeof(h), PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	memcpy(&h, map, sizeof(h));
+	munmap(map, sizeof(h));
+	if (h.magic != ZOOM_RAW_MAGIC || h.version != ZOOM_RAW_VERSION ||
+	    !h.channels || h.channels > ZOOM_MAX_CHANNELS ||
+	    h.records & (h.records - 1)) {
+		fprintf(stderr, "%s: not a zoom raw capture device\n",
+			opt.device);
+		return 1;
+	}
+
+	map_size = h.data_offset + (size_t)h.records * h.record_size;
+	map = mmap(NULL, map_size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	hdr = map;
+	ring = (const uint8_t *)map + h.data_offset;
+	channels = hdr->channels;
+
+	rec = malloc(hdr->record_size);
+	if (!rec) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	ret = uring_init(&uring, channels * opt.depth);
+	use_uring = !ret;
+	if (ret)
+		fprintf(stderr, "io_uring: %s, using pwrite\n", strerror(-ret));
+
+	tracks_open();
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	fprintf(stderr, "recording %u channels at %u Hz to %s/%s-NN.wav "
+		"(%s%s)\n", channels, hdr->rate, opt.dir, opt.prefix,
+		use_uring ? "io_uring" : "pwrite",
+		opt.direct ? ", O_DIRECT" : "");
+
+	max_frames = opt.duration * hdr->rate;
+	pos = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+	last_report = now_ns();
+	while (!stop) {
+		head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+		if (head == pos) {
+			struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+			if (use_uring)
+				wait_writes(0);
+			/* poll() wakes on every URB, sleep a little first */
+			usleep(2000);
+			if (poll(&pfd, 1, 1000) < 0 && errno != EINTR) {
+				perror("poll");
+				break;
+			}
+			if (pfd.revents & (POLLERR | POLLHUP)) {
+				fprintf(stderr, "device disconnected\n");
+				break;
+			}
+		}
+
+		for (; pos != head; pos++) {
+			if (head - pos > hdr->records) {
+				st.xruns++;
+				st.lost_records += head - hdr->records - pos;
+				pos = head - hdr->records;
+			}
+			if (!record_get(pos, rec)) {
+				/* overwritten while copying */
+				st.xruns++;
+				st.lost_records++;
+				continue;
+			}
+			if (last_ts && rec->tstamp_ns - last_ts > st.urb_gap_max_ns)
+				st.urb_gap_max_ns = rec->tstamp_ns - last_ts;
+			last_ts = rec->tstamp_ns;
+
+			frames = rec->frames;
+			if (max_frames && frames > max_frames - st.frames)
+				frames = max_frames - st.frames;
+			tracks_push((const int32_t *)(rec + 1), frames);
+			st.records++;
+			st.frames += frames;
+			if (max_frames && st.frames == max_frames) {
+				stop = 1;
+				break;
+			}
+		}
+
+		now = now_ns();
+		if (!opt.quiet && now - last_report >= 1000000000) {
+			report(stderr, "\r");
+			last_report = now;
+		}
+	}
+
+	tracks_close();
+	report(stderr, "\n");
+	munmap(map, map_size);
+	close(fd);
+	return st.xruns ? 3 : 0;
+}
@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * zoom-replay: runs a debugfs urb_log recording through the driver's
+ * capture copy plans (pack.c, built unchanged) without a device
+ *
+ * IN records go through the capture plan, OUT records through the loopback
+ * plan, with the same slot selection, format and activity scan as in the
+ * URB handlers. The output is the raw interleaved PCM the ALSA buffer would
+ * receive, so it can be compared bit for bit with `arecord -t raw` of the
+ * same session or profiled under perf.
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "uapi.h"
+#include "pack.h"
+
+/* default activity threshold of pcm.c, 16 bit scale */
+#define ACTIVITY_THRESHOLD 33
+
+static struct {
+	unsigned int dir;      /* ZOOM_URB_LOG_IN or ZOOM_URB_LOG_OUT */
+	unsigned int channels; /* live slots of the model in that direction */
+	u8 sel[ZOOM_MAX_SLOTS]; /* model channel of each output channel */
+	unsigned int n_sel;
+	snd_pcm_format_t format;
+	unsigned int threshold;
+	bool verbose;
+} opt = {
+	.dir = ZOOM_URB_LOG_IN,
+	.format = SNDRV_PCM_FORMAT_S32_LE,
+	.threshold = ACTIVITY_THRESHOLD,
+};
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+/* "1-4,7" -> opt.sel (0 based), the order is kept like a channel map */
+static int parse_channels(const char *s)
+{
+	char *end;
+	long a, b;
+
+	opt.n_sel = 0;
+	while (*s) {
+		a = strtol(s, &end, 10);
+		b = a;
+		if (*end == '-')
+			b = strtol(end + 1, &end, 10);
+		if (end == s || a < 1 || b < a || b > ZOOM_MAX_SLOTS ||
+		    opt.n_sel + (b - a + 1) > ZOOM_MAX_SLOTS)
+			return -1;
+		while (a <= b)
+			opt.sel[opt.n_sel++] = a++ - 1;
+		s = end;
+		if (*s == ',')
+			s++;
+		else if (*s)
+			return -1;
+	}
+	return opt.n_sel ? 0 : -1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options] recording.zrl output.raw\n"
+		"  -d dir    in (capture, default) or out (loopback)\n"
+		"  -C n      live channels of the model (default in 12, out 4)\n"
+		"  -c list   channels in output order, 1 based (\"2,1,3-6\",\n"
+		"            default all)\n"
+		"  -f fmt    s32 (default) or s16\n"
+		"  -a n      activity threshold, 16 bit scale (default %u)\n"
+		"  -v        one line per URB: time, status, frames, activity\n"
+		"output \"-\" writes to stdout\n", prog, ACTIVITY_THRESHOLD);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const struct zoom_urb_log_header *hdr;
+	const char *sel_list = NULL;
+	u64 urbs = 0, frames = 0, errors = 0, t0 = 0;
+	u8 slot_map[ZOOM_MAX_SLOTS];
+	struct zoom_plan plan;
+	struct stat stbuf;
+	size_t size, off, out_len = 0;
+	unsigned int k, n, frame_bytes;
+	u32 active, all_active = 0;
+	uint8_t *in, *out = NULL;
+	double t1, t2;
+	FILE *f;
+	int fd, c;
+
+	while ((c = getopt(argc, argv, "d:C:c:f:a:vh")) != -1) {
+		switch (c) {
+		case 'd':
+			if (!strcmp(optarg, "in"))
+				opt.dir = ZOOM_URB_LOG_IN;
+			else if (!strcmp(optarg, "out"))
+				opt.dir = ZOOM_URB_LOG_OUT;
+			else
+				usage(argv[0]);
+			break;
+		case 'C':
+			opt.channels = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			sel_list = optarg;
+			break;
+		case 'f':
+			if (!strcmp(optarg, "s32"))
+				opt.format = SNDRV_PCM_FORMAT_S32_LE;
+			else if (!strcmp(optarg, "s16"))
+				opt.format = SNDRV_PCM_FORMAT_S16_LE;
+			else
+				usage(argv[0]);
+			break;
+		case 'a':
+			opt.threshold = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			opt.verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!opt.channels)
+		opt.channels = opt.dir == ZOOM_URB_LOG_IN ? 12 : 4;
+	if (argc - optind != 2 || opt.channels > ZOOM_MAX_SLOTS ||
+	    opt.threshold > 32767)
+		usage(argv[0]);
+	if (sel_list) {
+		if (parse_channels(sel_list))
+			usage(argv[0]);
+	} else {
+		for (k = 0; k < opt.channels; k++)
+			opt.sel[k] = k;
+		opt.n_sel = opt.channels;
+	}
+	for (k = 0; k < opt.n_sel; k++) {
+		if (opt.sel[k] >= opt.channels) {
+			fprintf(stderr, "channel %u: the model has %u\n",
+				opt.sel[k] + 1, opt.channels);
+			return 1;
+		}
+	}
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &stbuf))
+		die(argv[optind]);
+	size = stbuf.st_size;
+	in = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	if (in == MAP_FAILED)
+		die("mmap");
+	close(fd);
+
+	hdr = (const void *)in;
+	if (size < sizeof(*hdr) || hdr->magic != ZOOM_URB_LOG_MAGIC ||
+	    hdr->version != ZOOM_URB_LOG_VERSION || !hdr->slots ||
+	    hdr->slots > ZOOM_MAX_SLOTS || opt.channels > hdr->slots) {
+		fprintf(stderr, "%s: not an urb_log recording of this layout\n",
+			argv[optind]);
+		return 1;
+	}
+	frame_bytes = hdr->slots * 4;
+
+	/* the kernel selection of the driver, SIMD for large urbs */
+	if (zoom_pack_init())
+		die("zoom_pack_init");
+
+	/* all models carry their live channels in slots 0..n-1 (driver.c) */
+	for (k = 0; k < opt.n_sel; k++)
+		slot_map[k] = opt.sel[k];
+	if (zoom_plan_init(&plan, false, slot_map, NULL, hdr->slots,
+			   opt.n_sel, opt.format)) {
+		fprintf(stderr, "no copy plan for %u channels\n", opt.n_sel);
+		return 1;
+	}
+	for (k = 0; k < opt.channels; k++)
+		slot_map[k] = k;
+
+	/* no more frames than payload bytes in the file */
+	out = malloc(size / frame_bytes * plan.frame_bytes + 1);
+	if (!out)
+		die("malloc");
+
+	t1 = now_s();
+	for (off = sizeof(*hdr); off + sizeof(struct zoom_urb_log_record) <= size;) {
+		const struct zoom_urb_log_record *rec = (const void *)(in + off);
+		__le32 *payload = (void *)(rec + 1); /* only read */
+
+		off += sizeof(*rec) + rec->length;
+		if (off > size) {
+			fprintf(stderr, "truncated after %llu URBs\n",
+				(unsigned long long)urbs);
+			break;
+		}
+		if (rec->dir != opt.dir)
+			continue;
+		if (!t0)
+			t0 = rec->tstamp_ns;
+
+		/* the handlers stop the stream on errors, nothing is copied */
+		if (rec->status) {
+			errors++;
+			if (opt.verbose)
+				fprintf(stderr, "%12.6f status %d\n",
+				       (rec->tstamp_ns - t0) / 1e9, rec->status);
+			continue;
+		}
+
+		n = rec->length / frame_bytes;
+		plan.copy(&plan, out + out_len, payload, n);
+		out_len += (size_t)n * plan.frame_bytes;
+
+		active = zoom_activity(payload, n, hdr->slots, slot_map,
+				       opt.channels, opt.threshold << 16);
+		all_active |= active;
+		if (opt.verbose)
+			fprintf(stderr, "%12.6f %4u frames active 0x%08x\n",
+			       (rec->tstamp_ns - t0) / 1e9, n, active);
+		urbs++;
+		frames += n;
+	}
+	t2 = now_s();
+
+	f = strcmp(argv[optind + 1], "-") ? fopen(argv[optind + 1], "wb") :
+					    stdout;
+	if (!f || fwrite(out, 1, out_len, f) != out_len || fflush(f))
+		die(argv[optind + 1]);
+	if (f != stdout)
+		fclose(f);
+
+	fprintf(stderr, "%llu %s URBs, %llu frames, %llu errors, "
+		"active 0x%08x; copy %.3f s (%.1f us per URB)\n",
+		(unsigned long long)urbs,
+		opt.dir == ZOOM_URB_LOG_IN ? "IN" : "OUT",
+		(unsigned long long)frames, (unsigned long long)errors,
+		all_active, t2 - t1, urbs ? (t2 - t1) * 1e6 / urbs : 0);
+	free(out);
+	if (in)
+		munmap(in, size);
+	return 0;
+}
@@ -0,0 +1,603 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * zoom-sim: discrete-event simulation of the capture URB pipeline
+ *
+ * Models what pcm.c does with the URBs of both directions:
+ *
+ * IN: the device streams frames into the URB the host controller is
+ * filling, a filled URB completes after the completion jitter, its handler
+ * runs after the host scheduling delay, copies into the ALSA ring and
+ * resubmits. When no URB is queued the device FIFO fills up and overflows
+ * (lost frames). On each period boundary the client is woken after its
+ * wakeup latency and reads everything; a capture xrun is the ring
+ * overflowing before that.
+ *
+ * OUT: the device plays the queued URBs back to back, each completes once
+ * played (plus jitter), its handler (after the host delay) refills it and
+ * queues it behind the others. If the queue ran dry first, the device
+ * played silence (underrun). The frames wait behind the URBs still queued:
+ * that is the playback latency the URB count buys.
+ *
+ * A glitch is a capture xrun, a FIFO overflow or an underrun. Each
+ * configuration of URB count x frames per URB x period size is simulated
+ * with the same random stream and reported as glitch rate and probability
+ * per period and the latency of both directions (capture: age of the
+ * oldest frame when the client reads it, playback: time from the refill
+ * until the device plays the frames).
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "uapi.h"
+
+#define MAX_URBS  64
+#define MAX_LIST  16
+#define LAT_HIST  4096 /* 10 us buckets, 40.96 ms */
+
+/* delay distribution, all values in ns */
+struct dist {
+	enum { DIST_CONST, DIST_UNIFORM, DIST_EXP, DIST_NORMAL, DIST_EMPIRIC }
+		type;
+	double a, b;
+	double *samples; /* DIST_EMPIRIC */
+	size_t n, alloc;
+	const char *spec;
+};
+
+enum event_type {
+	EV_FILLED,  /* the controller finished filling an URB */
+	EV_HANDLER, /* completion handler runs */
+	EV_WAKE,    /* client wakes up and reads */
+	EV_PLAYED,  /* the device played an OUT URB */
+	EV_REFILL,  /* OUT completion handler runs */
+};
+
+struct event {
+	double t;
+	enum event_type type;
+	unsigned int urb;
+};
+
+struct config {
+	unsigned int urbs;
+	unsigned int urb_frames;
+	unsigned int period;
+};
+
+struct result {
+	uint64_t periods;
+	uint64_t xruns;       /* ALSA ring overruns */
+	uint64_t overflows;   /* device FIFO overflows */
+	uint64_t lost_frames; /* by those */
+	uint64_t stalls;      /* no IN URB queued */
+	uint64_t underruns;   /* no OUT URB queued */
+	uint64_t silence;     /* frames played instead */
+	uint64_t lat_hist[LAT_HIST + 1];
+	uint64_t reads;
+	double lat_sum, lat_max;
+	uint64_t refills;
+	double out_lat_sum, out_lat_max;
+};
+
+static struct {
+	double seconds;
+	unsigned int rate;
+	unsigned int periods;
+	unsigned int fifo;
+	uint64_t seed;
+	struct dist jitter, host, wake;
+	unsigned int urbs[MAX_LIST], n_urbs;
+	unsigned int urb_frames[MAX_LIST], n_urb_frames;
+	unsigned int period[MAX_LIST], n_period;
+} opt = {
+	.seconds = 600,
+	.rate = 48000,
+	.periods = 2,
+	.fifo = 8,
+	.seed = 1,
+};
+
+static uint64_t rng;
+
+static double rnd(void)
+{
+	/* xorshift64* */
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return ((rng * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double dist_sample(const struct dist *d)
+{
+	double v, u;
+
+	switch (d->type) {
+	case DIST_CONST:
+		return d->a;
+	case DIST_UNIFORM:
+		return d->a + (d->b - d->a) * rnd();
+	case DIST_EXP:
+		return -d->a * log(1.0 - rnd());
+	case DIST_NORMAL:
+		u = rnd();
+		v = d->a + d->b * sqrt(-2.0 * log(1.0 - u)) *
+			   cos(2.0 * M_PI * rnd());
+		return v > 0 ? v : 0;
+	case DIST_EMPIRIC:
+		return d->samples[(size_t)(rnd() * d->n)];
+	}
+	return 0;
+}
+
+static void dist_add(struct dist *d, double v)
+{
+	if (d->n == d->alloc) {
+		d->alloc = d->alloc ? d->alloc * 2 : 4096;
+		d->samples = realloc(d->samples, d->alloc *
+				     sizeof(*d->samples));
+		if (!d->samples) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	d->samples[d->n++] = v;
+}
+
+/* histogram file: one delay in us per line */
+static int dist_load_text(struct dist *d, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	double v;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	while (fscanf(f, "%lf", &v) == 1)
+		dist_add(d, v * 1000);
+	fclose(f);
+	return 0;
+}
+
+/*
+ * urb_log recording: the lateness of every IN completion against the ideal
+ * completion time (frames since the first URB / rate) is the jitter.
+ */
+static int dist_load_zrl(struct dist *d, const char *path)
+{
+	struct zoom_urb_log_header h;
+	struct zoom_urb_log_record rec;
+	uint64_t t0 = 0, frames = 0;
+	double late, min = 0;
+	size_t i;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	if (fread(&h, sizeof(h), 1, f) != 1 || h.magic != ZOOM_URB_LOG_MAGIC ||
+	    !h.slots || !h.rate) {
+		fprintf(stderr, "%s: not an urb_log recording\n", path);
+		fclose(f);
+		return -1;
+	}
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (fseek(f, rec.length, SEEK_CUR))
+			break;
+		if (rec.dir != ZOOM_URB_LOG_IN || rec.status)
+			continue;
+		if (!t0)
+			t0 = rec.tstamp_ns;
+		frames += rec.length / (h.slots * 4);
+		late = (double)(rec.tstamp_ns - t0) -
+		       (double)frames * 1e9 / h.rate;
+		dist_add(d, late);
+		if (late < min)
+			min = late;
+	}
+	fclose(f);
+
+	/* the first URB had some lateness too, rebase on the earliest */
+	for (i = 0; i < d->n; i++)
+		d->samples[i] -= min;
+	return 0;
+}
+
+/*
+ * "const:us", "uniform:min:max", "exp:mean", "normal:mean:sd",
+ * "file:path" (us per line) or "zrl:path" (urb_log recording)
+ */
+static int dist_parse(struct dist *d, const char *spec)
+{
+	const char *arg = strchr(spec, ':');
+	char *end;
+
+	memset(d, 0, sizeof(*d));
+	d->spec = spec;
+	if (!arg)
+		return -1;
+	arg++;
+
+	if (!strncmp(spec, "file:", 5)) {
+		d->type = DIST_EMPIRIC;
+		return dist_load_text(d, arg) || !d->n ? -1 : 0;
+	}
+	if (!strncmp(spec, "zrl:", 4)) {
+		d->type = DIST_EMPIRIC;
+		return dist_load_zrl(d, arg) || !d->n ? -1 : 0;
+	}
+
+	d->a = strtod(arg, &end) * 1000;
+	if (*end == ':')
+		d->b = strtod(end + 1, &end) * 1000;
+	if (*end)
+		return -1;
+
+	if (!strncmp(spec, "const:", 6))
+		d->type = DIST_CONST;
+	else if (!strncmp(spec, "uniform:", 8))
+		d->type = DIST_UNIFORM;
+	else if (!strncmp(spec, "exp:", 4))
+		d->type = DIST_EXP;
+	else if (!strncmp(spec, "normal:", 7))
+		d->type = DIST_NORMAL;
+	else
+		return -1;
+	return 0;
+}
+
+/* binary min-heap of pending events */
+static struct event heap[5 * MAX_URBS + 4];
+static unsigned int heap_n;
+
+static void ev_push(double t, enum event_type type, unsigned int urb)
+{
+	unsigned int i = heap_n++, p;
+
+	while (i && heap[p = (i - 1) / 2].t > t) {
+		heap[i] = heap[p];
+		i = p;
+	}
+	heap[i] = (struct event){ .t = t, .type = type, .urb = urb };
+}
+
+static struct event ev_pop(void)
+{
+	struct event top = heap[0], last = heap[--heap_n];
+	unsigned int i = 0, c;
+
+	while ((c = 2 * i + 1) < heap_n) {
+		if (c + 1 < heap_n && heap[c + 1].t < heap[c].t)
+			c++;
+		if (heap[c].t >= last.t)
+			break;
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = last;
+	return top;
+}
+
+static void simulate(const struct config *cfg, struct result *res)
+{
+	double frame_ns = 1e9 / opt.rate, end = opt.seconds * 1e9;
+	uint64_t buffer = (uint64_t)cfg->period * opt.periods;
+	unsigned int queue[MAX_URBS] = { 0 }, q_head = 0, q_len;
+	uint64_t hw = 0, appl = 0, next_period = cfg->period;
+	uint64_t produced = 0; /* frames taken from the device */
+	uint64_t urb_end[MAX_URBS]; /* device frame after the URB data */
+	uint64_t hw_dev = 0, appl_dev = 0; /* device frame of hw and appl */
+	double urb_ns = cfg->urb_frames * frame_ns;
+	double out_end; /* the device has played everything queued */
+	double wait;
+	int64_t waiting;
+	bool filling = false, wake_pending = false;
+	unsigned int i, u;
+
+	memset(res, 0, sizeof(*res));
+	rng = opt.seed;
+	heap_n = 0;
+
+	/* all URBs queued at start, the first one starts filling */
+	for (i = 0; i < cfg->urbs; i++)
+		queue[i] = i;
+	q_len = cfg->urbs;
+
+#define START_FILL(now)							\
+	do {								\
+		u = queue[q_head];					\
+		q_head = (q_head + 1) % MAX_URBS;			\
+		q_len--;						\
+		produced += cfg->urb_frames;				\
+		urb_end[u] = produced;					\
+		/* frames due at the device minus those already waiting */ \
+		ev_push(fmax((now), produced * frame_ns), EV_FILLED, u); \
+		filling = true;						\
+	} while (0)
+
+	START_FILL(0.0);
+
+	/* OUT: all URBs queued with silence, played back to back */
+	for (i = 0; i < cfg->urbs; i++)
+		ev_push((i + 1) * urb_ns, EV_PLAYED, i);
+	out_end = cfg->urbs * urb_ns;
+
+	while (heap_n) {
+		struct event ev = ev_pop();
+
+		if (ev.t > end)
+			break;
+
+		switch (ev.type) {
+		case EV_FILLED:
+			filling = false;
+			ev_push(ev.t + dist_sample(&opt.jitter) +
+				dist_sample(&opt.host), EV_HANDLER, ev.urb);
+			if (q_len)
+				START_FILL(ev.t);
+			break;
+
+		case EV_HANDLER:
+			/* copy into the ring */
+			hw += cfg->urb_frames;
+			hw_dev = urb_end[ev.urb];
+			if (hw - appl > buffer) {
+				res->xruns++;
+				/* snd_pcm_stop + restart, data lost */
+				appl = hw;
+				appl_dev = hw_dev;
+			}
+			if (hw >= next_period) {
+				while (next_period <= hw) {
+					next_period += cfg->period;
+					res->periods++;
+				}
+				if (!wake_pending) {
+					wake_pending = true;
+					ev_push(ev.t + dist_sample(&opt.wake),
+						EV_WAKE, 0);
+				}
+			}
+
+			/* resubmit */
+			queue[(q_head + q_len) % MAX_URBS] = ev.urb;
+			q_len++;
+			if (!filling) {
+				/* the device FIFO bridged the gap or not,
+				 * nothing waits if the URB came early */
+				waiting = (int64_t)(ev.t / frame_ns) -
+					  (int64_t)produced;
+				res->stalls++;
+				if (waiting > opt.fifo) {
+					res->overflows++;
+					res->lost_frames += waiting - opt.fifo;
+					produced += waiting - opt.fifo;
+				}
+				START_FILL(ev.t);
+			}
+			break;
+
+		case EV_WAKE: {
+			/* age of the oldest unread frame */
+			double age = ev.t - appl_dev * frame_ns;
+			unsigned int bucket = age / 10000;
+
+			wake_pending = false;
+			if (hw == appl)
+				break;
+			res->reads++;
+			res->lat_sum += age;
+			if (age > res->lat_max)
+				res->lat_max = age;
+			res->lat_hist[bucket < LAT_HIST ? bucket : LAT_HIST]++;
+			appl = hw;
+			appl_dev = hw_dev;
+			break;
+		}
+
+		case EV_PLAYED:
+			ev_push(ev.t + dist_sample(&opt.jitter) +
+				dist_sample(&opt.host), EV_REFILL, ev.urb);
+			break;
+
+		case EV_REFILL:
+			/* queued behind the others, or late: silence */
+			if (ev.t > out_end) {
+				res->underruns++;
+				res->silence += (ev.t - out_end) / frame_ns;
+				out_end = ev.t;
+			}
+			wait = out_end - ev.t;
+			res->refills++;
+			res->out_lat_sum += wait;
+			if (wait > res->out_lat_max)
+				res->out_lat_max = wait;
+			out_end += urb_ns;
+			ev_push(out_end, EV_PLAYED, ev.urb);
+			break;
+		}
+	}
+#undef START_FILL
+}
+
+static double lat_percentile(const struct result *res, double pct)
+{
+	uint64_t want = res->reads * pct / 100, n = 0;
+	unsigned int i;
+
+	for (i = 0; i <= LAT_HIST; i++) {
+		n += res->lat_hist[i];
+		if (n > want)
+			return (i + 1) * 0.01; /* ms, bucket upper bound */
+	}
+	return LAT_HIST * 0.01;
+}
+
+static int parse_list(const char *s, unsigned int *list, unsigned int *n,
+		      unsigned int max)
+{
+	char *end;
+
+	*n = 0;
+	while (*s) {
+		if (*n == MAX_LIST)
+			return -1;
+		list[*n] = strtoul(s, &end, 0);
+		if (end == s || !list[*n] || list[*n] > max)
+			return -1;
+		(*n)++;
+		s = *end == ',' ? end + 1 : end;
+		if (*end && *end != ',')
+			return -1;
+	}
+	return *n ? 0 : -1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -n list   URBs in flight (default 4)\n"
+		"  -u list   frames per URB (default 4, 512 byte URBs)\n"
+		"  -p list   period size in frames (default 64)\n"
+		"  -P n      periods per buffer (default 2)\n"
+		"  -F n      device FIFO in frames (default 8)\n"
+		"  -j dist   URB completion jitter (default exp:20)\n"
+		"  -s dist   host scheduling delay of the handler (default exp:10)\n"
+		"  -w dist   client wakeup latency (default exp:200)\n"
+		"  -t secs   simulated time per configuration (default 600)\n"
+		"  -r rate   sample rate (default 48000)\n"
+		"  -S seed   random seed (default 1)\n"
+		"dist: const:us, uniform:min:max, exp:mean, normal:mean:sd,\n"
+		"      file:path (one delay in us per line),\n"
+		"      zrl:path (completion jitter of a debugfs urb_log recording)\n"
+		"lists are comma separated, every combination is simulated\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *jitter = "exp:20", *host = "exp:10", *wake = "exp:200";
+	struct result res;
+	struct config cfg;
+	uint64_t glitches;
+	unsigned int a, b, c;
+	int ch;
+
+	opt.urbs[0] = 4;
+	opt.n_urbs = 1;
+	opt.urb_frames[0] = 4;
+	opt.n_urb_frames = 1;
+	opt.period[0] = 64;
+	opt.n_period = 1;
+
+	while ((ch = getopt(argc, argv, "n:u:p:P:F:j:s:w:t:r:S:h")) != -1) {
+		switch (ch) {
+		case 'n':
+			if (parse_list(optarg, opt.urbs, &opt.n_urbs, MAX_URBS))
+				usage(argv[0]);
+			break;
+		case 'u':
+			if (parse_list(optarg, opt.urb_frames,
+				       &opt.n_urb_frames, 4096))
+				usage(argv[0]);
+			break;
+		case 'p':
+			if (parse_list(optarg, opt.period, &opt.n_period,
+				       1 << 20))
+				usage(argv[0]);
+			break;
+		case 'P':
+			opt.periods = strtoul(optarg, NULL, 0);
+			break;
+		case 'F':
+			opt.fifo = strtoul(optarg, NULL, 0);
+			break;
+		case 'j':
+			jitter = optarg;
+			break;
+		case 's':
+			host = optarg;
+			break;
+		case 'w':
+			wake = optarg;
+			break;
+		case 't':
+			opt.seconds = strtod(optarg, NULL);
+			break;
+		case 'r':
+			opt.rate = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			opt.seed = strtoull(optarg, NULL, 0) ?: 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || opt.periods < 2 || !opt.rate ||
+	    opt.seconds <= 0)
+		usage(argv[0]);
+	if (dist_parse(&opt.jitter, jitter) || dist_parse(&opt.host, host) ||
+	    dist_parse(&opt.wake, wake)) {
+		fprintf(stderr, "bad distribution\n");
+		usage(argv[0]);
+	}
+
+	printf("# %.0f s per configuration, %u Hz, %u periods, fifo %u frames\n"
+	       "# jitter %s, host %s, wakeup %s\n", opt.seconds, opt.rate,
+	       opt.periods, opt.fifo, jitter, host, wake);
+	printf("%5s %6s %7s %7s %10s %9s %9s %9s %8s %8s %8s %8s %8s\n",
+	       "urbs", "frames", "period", "xruns", "glitch/h", "p(glitch)",
+	       "lost", "silence", "lat avg", "lat p99", "lat max", "out avg",
+	       "out max");
+
+	for (a = 0; a < opt.n_urbs; a++) {
+		for (b = 0; b < opt.n_urb_frames; b++) {
+			for (c = 0; c < opt.n_period; c++) {
+				cfg.urbs = opt.urbs[a];
+				cfg.urb_frames = opt.urb_frames[b];
+				cfg.period = opt.period[c];
+				simulate(&cfg, &res);
+				glitches = res.xruns + res.overflows +
+					   res.underruns;
+
+				/* p(glitch): per period */
+				printf("%5u %6u %7u %7llu %10.1f %9.2e %9llu "
+				       "%9llu %8.3f %8.2f %8.3f %8.3f %8.3f\n",
+				       cfg.urbs, cfg.urb_frames, cfg.period,
+				       (unsigned long long)res.xruns,
+				       glitches * 3600.0 / opt.seconds,
+				       res.periods ? (double)glitches /
+						     res.periods : 0,
+				       (unsigned long long)res.lost_frames,
+				       (unsigned long long)res.silence,
+				       res.reads ? res.lat_sum / res.reads / 1e6 : 0,
+				       lat_percentile(&res, 99),
+				       res.lat_max / 1e6,
+				       res.refills ? res.out_lat_sum /
+						     res.refills / 1e6 : 0,
+				       res.out_lat_max / 1e6);
+			}
+		}
+	}
+	return 0;
+}
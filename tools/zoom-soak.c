@@ -0,0 +1,647 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * zoom-soak: open/prepare/close stress of the PCM (and /dev/zoomN) paths
+ *
+ * Several threads per stream direction run open, hw_params, prepare, start,
+ * stop and close cycles against the same card at once, through the plain
+ * ALSA ioctls (no alsa-lib). This hammers stream_mutex, the shared stream
+ * state and the start/stop paths that only one client at a time would see.
+ *
+ * Reports latency percentiles and errors per operation. A watchdog aborts
+ * with the stuck thread and operation when one takes longer than the
+ * timeout (deadlock). Before and after the run the lockdep state and
+ * optionally a kmemleak scan are checked, and all substreams must be closed
+ * again.
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <sound/asound.h>
+
+#define MAX_THREADS 64
+
+enum op {
+	OP_OPEN,
+	OP_HW_PARAMS,
+	OP_PREPARE,
+	OP_START,
+	OP_STOP,
+	OP_CLOSE,
+	OP_RAW_OPEN,
+	OP_RAW_CLOSE,
+	OP_COUNT
+};
+
+static const char *const op_names[OP_COUNT] = {
+	"open", "hw_params", "prepare", "start", "stop", "close",
+	"raw open", "raw close",
+};
+
+struct op_stats {
+	uint64_t *ns; /* one sample per successful call */
+	size_t n;
+	uint64_t errors, busy;
+	int last_errno;
+};
+
+struct worker {
+	pthread_t thread;
+	pid_t tid;
+	unsigned int id;
+	int stream; /* SNDRV_PCM_STREAM_XXX, -1 for /dev/zoomN */
+	struct op_stats ops[OP_COUNT];
+	_Atomic int cur_op;          /* -1 between operations */
+	_Atomic uint64_t cur_start;  /* ns */
+	uint64_t cycles;
+};
+
+static struct {
+	unsigned int card, device;
+	bool playback, capture;
+	unsigned int threads;   /* per direction */
+	unsigned int raw_threads;
+	const char *raw;
+	unsigned int cycles;
+	unsigned int run_us;    /* between start and stop */
+	unsigned int rate, channels, period, periods;
+	bool nonblock;
+	double timeout;
+	double limit_ms;        /* 0: no latency limit */
+	bool kmemleak;
+} opt = {
+	.card = 1,
+	.playback = true,
+	.capture = true,
+	.threads = 4,
+	.cycles = 1000,
+	.run_us = 2000,
+	.rate = 48000,
+	.channels = 2,
+	.period = 64,
+	.periods = 4,
+	.timeout = 5,
+};
+
+static struct worker workers[MAX_THREADS * 2 + MAX_THREADS];
+static unsigned int n_workers;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void op_begin(struct worker *w, enum op op)
+{
+	atomic_store(&w->cur_start, now_ns());
+	atomic_store(&w->cur_op, op);
+}
+
+/* ret < 0: -errno */
+static void op_end(struct worker *w, enum op op, int ret)
+{
+	struct op_stats *s = &w->ops[op];
+	uint64_t t = now_ns() - atomic_load(&w->cur_start);
+
+	atomic_store(&w->cur_op, -1);
+	if (ret == -EBUSY && opt.nonblock) {
+		s->busy++;
+	} else if (ret < 0) {
+		s->errors++;
+		s->last_errno = -ret;
+	} else {
+		s->ns[s->n++] = t;
+	}
+}
+
+static struct snd_mask *hw_mask(struct snd_pcm_hw_params *p, int var)
+{
+	return &p->masks[var - SNDRV_PCM_HW_PARAM_FIRST_MASK];
+}
+
+static struct snd_interval *hw_interval(struct snd_pcm_hw_params *p, int var)
+{
+	return &p->intervals[var - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL];
+}
+
+static void hw_set_mask(struct snd_pcm_hw_params *p, int var, unsigned int v)
+{
+	struct snd_mask *m = hw_mask(p, var);
+
+	memset(m, 0, sizeof(*m));
+	m->bits[v / 32] = 1U << (v % 32);
+}
+
+static void hw_set_interval(struct snd_pcm_hw_params *p, int var,
+			    unsigned int v)
+{
+	struct snd_interval *i = hw_interval(p, var);
+
+	memset(i, 0, sizeof(*i));
+	i->min = v;
+	i->max = v;
+	i->integer = 1;
+}
+
+static int pcm_hw_params(int fd)
+{
+	struct snd_pcm_hw_params p;
+	int var;
+
+	memset(&p, 0, sizeof(p));
+	for (var = SNDRV_PCM_HW_PARAM_FIRST_MASK;
+	     var <= SNDRV_PCM_HW_PARAM_LAST_MASK; var++)
+		memset(hw_mask(&p, var), 0xff, sizeof(struct snd_mask));
+	for (var = SNDRV_PCM_HW_PARAM_FIRST_INTERVAL;
+	     var <= SNDRV_PCM_HW_PARAM_LAST_INTERVAL; var++)
+		hw_interval(&p, var)->max = ~0U;
+	p.rmask = ~0U;
+	p.info = ~0U;
+
+	hw_set_mask(&p, SNDRV_PCM_HW_PARAM_ACCESS,
+		    SNDRV_PCM_ACCESS_RW_INTERLEAVED);
+	hw_set_mask(&p, SNDRV_PCM_HW_PARAM_FORMAT, SNDRV_PCM_FORMAT_S32_LE);
+	hw_set_mask(&p, SNDRV_PCM_HW_PARAM_SUBFORMAT,
+		    SNDRV_PCM_SUBFORMAT_STD);
+	hw_set_interval(&p, SNDRV_PCM_HW_PARAM_CHANNELS, opt.channels);
+	hw_set_interval(&p, SNDRV_PCM_HW_PARAM_RATE, opt.rate);
+	hw_set_interval(&p, SNDRV_PCM_HW_PARAM_PERIOD_SIZE, opt.period);
+	hw_set_interval(&p, SNDRV_PCM_HW_PARAM_PERIODS, opt.periods);
+
+	return ioctl(fd, SNDRV_PCM_IOCTL_HW_PARAMS, &p) < 0 ? -errno : 0;
+}
+
+/*
+ * Playback starts by writing a full buffer of silence (start_threshold 1),
+ * capture with SNDRV_PCM_IOCTL_START.
+ */
+static int pcm_start(int fd, int stream, int32_t *silence)
+{
+	struct snd_xferi x = {
+		.buf = silence,
+		.frames = opt.period * opt.periods,
+	};
+
+	if (stream == SNDRV_PCM_STREAM_CAPTURE)
+		return ioctl(fd, SNDRV_PCM_IOCTL_START) < 0 ? -errno : 0;
+	return ioctl(fd, SNDRV_PCM_IOCTL_WRITEI_FRAMES, &x) < 0 ? -errno : 0;
+}
+
+static void pcm_cycle(struct worker *w, int32_t *silence)
+{
+	char path[64];
+	int fd, ret;
+
+	snprintf(path, sizeof(path), "/dev/snd/pcmC%uD%u%c", opt.card,
+		 opt.device, w->stream == SNDRV_PCM_STREAM_PLAYBACK ? 'p' : 'c');
+
+	op_begin(w, OP_OPEN);
+	fd = open(path, O_RDWR | O_CLOEXEC | (opt.nonblock ? O_NONBLOCK : 0));
+	op_end(w, OP_OPEN, fd < 0 ? -errno : 0);
+	if (fd < 0)
+		return;
+
+	op_begin(w, OP_HW_PARAMS);
+	ret = pcm_hw_params(fd);
+	op_end(w, OP_HW_PARAMS, ret);
+	if (ret < 0)
+		goto close;
+
+	op_begin(w, OP_PREPARE);
+	ret = ioctl(fd, SNDRV_PCM_IOCTL_PREPARE) < 0 ? -errno : 0;
+	op_end(w, OP_PREPARE, ret);
+	if (ret < 0)
+		goto close;
+
+	op_begin(w, OP_START);
+	ret = pcm_start(fd, w->stream, silence);
+	op_end(w, OP_START, ret);
+	if (ret < 0)
+		goto close;
+
+	if (opt.run_us)
+		usleep(opt.run_us);
+
+	op_begin(w, OP_STOP);
+	ret = ioctl(fd, SNDRV_PCM_IOCTL_DROP) < 0 ? -errno : 0;
+	op_end(w, OP_STOP, ret);
+
+close:
+	op_begin(w, OP_CLOSE);
+	ret = close(fd) < 0 ? -errno : 0;
+	op_end(w, OP_CLOSE, ret);
+}
+
+static void raw_cycle(struct worker *w)
+{
+	int fd, ret;
+
+	op_begin(w, OP_RAW_OPEN);
+	fd = open(opt.raw, O_RDONLY | O_CLOEXEC);
+	op_end(w, OP_RAW_OPEN, fd < 0 ? -errno : 0);
+	if (fd < 0)
+		return;
+
+	if (opt.run_us)
+		usleep(opt.run_us);
+
+	op_begin(w, OP_RAW_CLOSE);
+	ret = close(fd) < 0 ? -errno : 0;
+	op_end(w, OP_RAW_CLOSE, ret);
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	int32_t *silence = NULL;
+	unsigned int i;
+
+	w->tid = syscall(SYS_gettid);
+	if (w->stream == SNDRV_PCM_STREAM_PLAYBACK) {
+		silence = calloc((size_t)opt.period * opt.periods *
+				 opt.channels, sizeof(*silence));
+		if (!silence)
+			return NULL;
+	}
+
+	for (i = 0; i < opt.cycles; i++, w->cycles++) {
+		if (w->stream < 0)
+			raw_cycle(w);
+		else
+			pcm_cycle(w, silence);
+	}
+
+	free(silence);
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double percentile_ms(const uint64_t *v, size_t n, double p)
+{
+	size_t i;
+
+	if (!n)
+		return 0;
+	i = (size_t)(p / 100 * (n - 1) + 0.5);
+	return v[i] / 1e6;
+}
+
+/* 1: lockdep on, 0: turned itself off after a splat, -1: not available */
+static int lockdep_state(void)
+{
+	char line[128];
+	int state = -1;
+	FILE *f;
+
+	f = fopen("/proc/lockdep_stats", "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, " debug_locks: %d", &state) == 1)
+			break;
+	fclose(f);
+	return state;
+}
+
+/* number of unreferenced objects after a scan, -1 if not available */
+static int kmemleak_scan(void)
+{
+	const char *path = "/sys/kernel/debug/kmemleak";
+	char line[256];
+	int leaks = 0;
+	FILE *f;
+
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+	fputs("scan", f);
+	if (fclose(f))
+		return -1;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f))
+		if (strstr(line, "unreferenced object"))
+			leaks++;
+	fclose(f);
+	return leaks;
+}
+
+/* all substreams of the device closed again? */
+static bool substreams_closed(void)
+{
+	char path[96], line[64];
+	bool closed = true;
+	int dir;
+	FILE *f;
+
+	for (dir = 0; dir < 2; dir++) {
+		snprintf(path, sizeof(path),
+			 "/proc/asound/card%u/pcm%u%c/sub0/status", opt.card,
+			 opt.device, dir ? 'c' : 'p');
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		if (!fgets(line, sizeof(line), f) || strncmp(line, "closed", 6))
+			closed = false;
+		fclose(f);
+	}
+	return closed;
+}
+
+static void dump_stack(pid_t tid)
+{
+	char path[64], line[256];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/self/task/%d/stack", tid);
+	f = fopen(path, "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f))
+		fprintf(stderr, "    %s", line);
+	fclose(f);
+}
+
+/* returns false if a worker is stuck in an operation */
+static bool watchdog(void)
+{
+	uint64_t now = now_ns(), start;
+	unsigned int i;
+	int op;
+
+	for (i = 0; i < n_workers; i++) {
+		struct worker *w = &workers[i];
+
+		op = atomic_load(&w->cur_op);
+		start = atomic_load(&w->cur_start);
+		if (op < 0 || now - start < opt.timeout * 1e9)
+			continue;
+
+		fprintf(stderr, "stall: thread %u (tid %d) in %s for %.1f s "
+			"after %llu cycles\n", w->id, w->tid, op_names[op],
+			(now - start) / 1e9, (unsigned long long)w->cycles);
+		dump_stack(w->tid);
+		return false;
+	}
+	return true;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -c card     ALSA card number (default 1)\n"
+		"  -d device   PCM device (default 0)\n"
+		"  -s p|c|pc   streams to cycle (default pc)\n"
+		"  -j n        threads per stream (default 4)\n"
+		"  -R dev      also open/close /dev/zoomN\n"
+		"  -J n        threads for -R (default 1)\n"
+		"  -n cycles   cycles per thread (default 1000)\n"
+		"  -w us       running time between start and stop (default 2000)\n"
+		"  -C ch       channels (default 2)\n"
+		"  -r rate     sample rate (default 48000)\n"
+		"  -p frames   period size (default 64), 4 periods\n"
+		"  -N          non blocking open, EBUSY is not an error\n"
+		"  -t secs     watchdog timeout per operation (default 5)\n"
+		"  -l ms       fail if p99.9 of prepare, start or stop exceeds ms\n"
+		"  -k          kmemleak scan after the run (root, debugfs)\n"
+		"exit status: 1 errors or limits exceeded, 3 stall\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i, j, raw_threads = 1;
+	int lockdep_before, lockdep_after, leaks = -1;
+	bool fail = false, done;
+	uint64_t t0, t;
+	size_t total;
+	int ch, op;
+
+	while ((ch = getopt(argc, argv, "c:d:s:j:R:J:n:w:C:r:p:Nt:l:kh")) != -1) {
+		switch (ch) {
+		case 'c':
+			opt.card = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			opt.device = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			opt.playback = strchr(optarg, 'p');
+			opt.capture = strchr(optarg, 'c');
+			break;
+		case 'j':
+			opt.threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'R':
+			opt.raw = optarg;
+			break;
+		case 'J':
+			raw_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			opt.cycles = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			opt.run_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'C':
+			opt.channels = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			opt.rate = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			opt.period = strtoul(optarg, NULL, 0);
+			break;
+		case 'N':
+			opt.nonblock = true;
+			break;
+		case 't':
+			opt.timeout = strtod(optarg, NULL);
+			break;
+		case 'l':
+			opt.limit_ms = strtod(optarg, NULL);
+			break;
+		case 'k':
+			opt.kmemleak = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || !opt.cycles || !opt.channels || !opt.rate ||
+	    !opt.period || opt.timeout <= 0 || opt.threads > MAX_THREADS ||
+	    raw_threads > MAX_THREADS || (!opt.playback && !opt.capture &&
+					  !opt.raw))
+		usage(argv[0]);
+	opt.raw_threads = opt.raw ? raw_threads : 0;
+
+	for (i = 0; i < 3; i++) {
+		static const int streams[3] = {
+			SNDRV_PCM_STREAM_PLAYBACK, SNDRV_PCM_STREAM_CAPTURE, -1
+		};
+		unsigned int n = i == 2 ? opt.raw_threads : opt.threads;
+
+		if ((i == 0 && !opt.playback) || (i == 1 && !opt.capture))
+			continue;
+		for (j = 0; j < n; j++) {
+			struct worker *w = &workers[n_workers];
+
+			w->id = n_workers++;
+			w->stream = streams[i];
+			atomic_init(&w->cur_op, -1);
+			for (op = 0; op < OP_COUNT; op++) {
+				w->ops[op].ns = calloc(opt.cycles,
+						       sizeof(uint64_t));
+				if (!w->ops[op].ns) {
+					perror("calloc");
+					return 1;
+				}
+			}
+		}
+	}
+
+	lockdep_before = lockdep_state();
+	if (opt.kmemleak && kmemleak_scan() < 0)
+		fprintf(stderr, "kmemleak not available\n");
+
+	t0 = now_ns();
+	for (i = 0; i < n_workers; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_run,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	/* the workers can't be cancelled inside the driver, a stall exits */
+	do {
+		usleep(100000);
+		if (!watchdog())
+			_exit(3);
+		done = true;
+		for (i = 0; i < n_workers; i++)
+			if (workers[i].cycles < opt.cycles)
+				done = false;
+	} while (!done);
+
+	for (i = 0; i < n_workers; i++)
+		pthread_join(workers[i].thread, NULL);
+	t = now_ns() - t0;
+
+	printf("# card %u device %u: %u playback, %u capture, %u raw threads, "
+	       "%u cycles each, %.1f s\n", opt.card, opt.device,
+	       opt.playback ? opt.threads : 0, opt.capture ? opt.threads : 0,
+	       opt.raw_threads, opt.cycles, t / 1e9);
+	printf("%-10s %8s %8s %8s %9s %9s %9s %9s\n", "op", "calls", "errors",
+	       "busy", "p50 ms", "p99 ms", "p99.9 ms", "max ms");
+
+	for (op = 0; op < OP_COUNT; op++) {
+		struct op_stats all = { 0 };
+		uint64_t *v;
+		double p999;
+
+		total = 0;
+		for (i = 0; i < n_workers; i++)
+			total += workers[i].ops[op].n;
+		v = malloc((total ?: 1) * sizeof(*v));
+		if (!v) {
+			perror("malloc");
+			return 1;
+		}
+		for (i = 0; i < n_workers; i++) {
+			struct op_stats *s = &workers[i].ops[op];
+
+			memcpy(v + all.n, s->ns, s->n * sizeof(*v));
+			all.n += s->n;
+			all.errors += s->errors;
+			all.busy += s->busy;
+			if (s->errors)
+				all.last_errno = s->last_errno;
+		}
+		if (!all.n && !all.errors && !all.busy) {
+			free(v);
+			continue;
+		}
+		qsort(v, all.n, sizeof(*v), cmp_u64);
+		p999 = percentile_ms(v, all.n, 99.9);
+
+		printf("%-10s %8zu %8llu %8llu %9.3f %9.3f %9.3f %9.3f",
+		       op_names[op], all.n, (unsigned long long)all.errors,
+		       (unsigned long long)all.busy,
+		       percentile_ms(v, all.n, 50), percentile_ms(v, all.n, 99),
+		       p999, all.n ? v[all.n - 1] / 1e6 : 0);
+		if (all.errors) {
+			printf("  (%s)", strerror(all.last_errno));
+			fail = true;
+		}
+		if (opt.limit_ms && p999 > opt.limit_ms &&
+		    (op == OP_PREPARE || op == OP_START || op == OP_STOP)) {
+			printf("  over %.3f ms", opt.limit_ms);
+			fail = true;
+		}
+		printf("\n");
+		free(v);
+	}
+
+	if (!substreams_closed()) {
+		printf("substreams still open after the run\n");
+		fail = true;
+	}
+
+	lockdep_after = lockdep_state();
+	if (lockdep_before < 0)
+		printf("lockdep: not available\n");
+	else if (lockdep_before && !lockdep_after) {
+		printf("lockdep: turned off during the run, see dmesg\n");
+		fail = true;
+	} else {
+		printf("lockdep: %s\n", lockdep_after ? "clean" :
+			"already off before the run");
+	}
+
+	if (opt.kmemleak) {
+		leaks = kmemleak_scan();
+		if (leaks > 0) {
+			printf("kmemleak: %d unreferenced objects, see %s\n",
+			       leaks, "/sys/kernel/debug/kmemleak");
+			fail = true;
+		} else if (!leaks) {
+			printf("kmemleak: clean\n");
+		}
+	}
+
+	return fail;
+}
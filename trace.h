@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * Tracepoints: /sys/kernel/tracing/events/snd_usb_zoom/
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM snd_usb_zoom
+
+#if !defined(ZOOM_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define ZOOM_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(zoom_stream_state,
+	TP_PROTO(int card, u8 old, u8 new),
+	TP_ARGS(card, old, new),
+
+	TP_STRUCT__entry(
+		__field(int, card)
+		__field(u8, old)
+		__field(u8, new)
+	),
+
+	TP_fast_assign(
+		__entry->card = card;
+		__entry->old = old;
+		__entry->new = new;
+	),
+
+	TP_printk("card%d %s -> %s", __entry->card,
+		  __print_symbolic(__entry->old, { 0, "disabled" },
+				   { 1, "starting" }, { 2, "running" },
+				   { 3, "stopping" }),
+		  __print_symbolic(__entry->new, { 0, "disabled" },
+				   { 1, "starting" }, { 2, "running" },
+				   { 3, "stopping" }))
+);
+
+/* first completion of a direction after the urbs were submitted */
+TRACE_EVENT(zoom_stream_first_urb,
+	TP_PROTO(int card, bool in, u64 delay_ns),
+	TP_ARGS(card, in, delay_ns),
+
+	TP_STRUCT__entry(
+		__field(int, card)
+		__field(bool, in)
+		__field(u64, delay_ns)
+	),
+
+	TP_fast_assign(
+		__entry->card = card;
+		__entry->in = in;
+		__entry->delay_ns = delay_ns;
+	),
+
+	TP_printk("card%d first %s urb after %llu ns", __entry->card,
+		  __entry->in ? "IN" : "OUT", __entry->delay_ns)
+);
+
+/* frames missing (> 0) or extra (< 0) against CLOCK_MONOTONIC */
+TRACE_EVENT(zoom_stream_discontinuity,
+	TP_PROTO(int card, bool in, s64 frames),
+	TP_ARGS(card, in, frames),
+
+	TP_STRUCT__entry(
+		__field(int, card)
+		__field(bool, in)
+		__field(s64, frames)
+	),
+
+	TP_fast_assign(
+		__entry->card = card;
+		__entry->in = in;
+		__entry->frames = frames;
+	),
+
+	TP_printk("card%d %s %lld frames", __entry->card,
+		  __entry->in ? "IN" : "OUT", __entry->frames)
+);
+
+#endif /* ZOOM_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE trace
+#include <trace/define_trace.h>
@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later WITH Linux-syscall-note */
+/*
+ * Linux driver for ZOOM LiveTrak devices (L-8, L-12, L-20)
+ *
+ * Userspace interface of the /dev/zoomN raw capture device, the hwdep
+ * device and the debugfs URB log, shared with the tools.
+ *
+ * Copyright 2021 (C) Sebastian Reimers
+ *
+ * Authors:  Sebastian Reimers <hallo@studio-link.de>
+ *
+ */
+
+#ifndef ZOOM_UAPI_H
+#define ZOOM_UAPI_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define ZOOM_RAW_MAGIC   0x5741525a /* "ZRAW" */
+#define ZOOM_RAW_VERSION 1
+
+/*
+ * /dev/zoomN mmap layout: this header in the first page, followed by
+ * `records` records of `record_size` bytes. Record n of the stream lives
+ * at index n % records.
+ *
+ * Lock free reading: load `head` (acquire), for each record n < head
+ * read `seq`, copy the record, read `seq` again. The copy is valid if
+ * both reads return n, otherwise the producer overwrote it.
+ *
+ * read() returns whole records with the same layout, splice() works too.
+ */
+struct zoom_raw_header {
+	__u32 magic;
+	__u32 version;
+	__u32 channels;    /* S32_LE samples per frame (all live inputs) */
+	__u32 frames;      /* max frames per record */
+	__u32 record_size; /* bytes, record header included */
+	__u32 records;     /* ring size, power of two */
+	__u32 rate;
+	__u32 data_offset; /* offset of record 0 in the mapping */
+	__u64 head;        /* records written so far */
+};
+
+/* one capture URB, followed by frames * channels S32_LE samples */
+struct zoom_raw_record {
+	__u64 seq;       /* stream record number, ~0 while being written */
+	__u64 tstamp_ns; /* CLOCK_MONOTONIC URB completion time */
+	__u32 frames;    /* valid frames in this record */
+	__u32 active;    /* bit n: channel n reached the activity threshold */
+	__u64 reserved2;
+};
+
+/* streams of the hwdep scheduled start, bit n of zoom_sched.streams */
+#define ZOOM_SCHED_PLAYBACK 0 /* hw:N,0 */
+#define ZOOM_SCHED_CAPTURE  1 /* hw:N,0 */
+#define ZOOM_SCHED_LOOPBACK 2 /* hw:N,1 */
+#define ZOOM_SCHED_LOWRATE  3 /* hw:N,2 */
+#define ZOOM_SCHED_STREAMS  4
+
+/*
+ * Scheduled start on the hwdep device (hwCxD0, id "ZOOM"). After
+ * ZOOM_IOCTL_SCHED_START the next snd_pcm_start() of each stream in
+ * `streams` doesn't start it right away: the stream is RUNNING but stands
+ * still until the first URB that completes at or after `start_ns`
+ * (CLOCK_MONOTONIC), playback URBs by their expected completion. Its frames
+ * are the first ones played or captured. start_ns 0 disarms, waiting
+ * streams then start at once.
+ *
+ * ZOOM_IOCTL_SCHED_STATUS returns the still armed streams (`streams`,
+ * latest `start_ns`), the ones that started and the CLOCK_MONOTONIC time
+ * of their first frame (`started_ns`).
+ */
+struct zoom_sched {
+	__u64 start_ns;
+	__u32 streams;
+	__u32 started;
+	__u64 started_ns[ZOOM_SCHED_STREAMS];
+};
+
+#define ZOOM_IOCTL_SCHED_START  _IOW('Z', 0x01, struct zoom_sched)
+#define ZOOM_IOCTL_SCHED_STATUS _IOR('Z', 0x02, struct zoom_sched)
+
+#define ZOOM_URB_LOG_MAGIC   0x474c525a /* "ZRLG" */
+#define ZOOM_URB_LOG_VERSION 1
+
+#define ZOOM_URB_LOG_IN  0
+#define ZOOM_URB_LOG_OUT 1
+
+/*
+ * debugfs urb_log/urb_replay file: this header, then records. Every record
+ * is followed by `length` payload bytes (a multiple of 4), the raw URB
+ * buffer of `slots` 32 bit slots per frame.
+ */
+struct zoom_urb_log_header {
+	__u32 magic;
+	__u16 version;
+	__u16 slots;
+	__u32 rate;
+	__u32 reserved;
+};
+
+struct zoom_urb_log_record {
+	__u64 tstamp_ns; /* CLOCK_MONOTONIC URB completion time */
+	__s32 status;    /* urb->status */
+	__u16 length;    /* payload bytes (actual_length for IN) */
+	__u8 dir;        /* ZOOM_URB_LOG_IN or ZOOM_URB_LOG_OUT */
+	__u8 reserved;
+};
+
+#endif /* ZOOM_UAPI_H */